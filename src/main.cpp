@@ -7,6 +7,7 @@
 #include <map>
 #include <set>
 #include <sstream>
+#include <thread>
 #include <vector>
 #include "ANSI_esc.h"
 
@@ -133,6 +134,118 @@ static std::map<std::string, argHandler> argmap =
         }
     },
 
+    {
+        "regex",
+        argHandler {
+            "",
+            "Tokenize with the regex patterns instead of the scanner.",
+            [](int curArgc, int argc, char* argv[])  -> int
+            {
+                options.regexTokenizer = true;
+                return 0;
+            }
+        }
+    },
+    {
+        "j",
+        argHandler {
+            " Threads",
+            "Tokenize on N threads (0 = one per core).",
+            [](int curArgc, int argc, char* argv[])  -> int
+            {
+                if (curArgc >= argc) {
+                    std::cerr <<
+                        es.gr(es.BRIGHT_RED_FOREGROUND) <<
+                        "No thread count specified with " << "-j" << "\n" <<
+                        es.gr(es.RESET_ALL);
+                    return -1;
+                }
+                std::string arg = argv[curArgc++];
+                if (arg.empty() || arg.find_first_not_of("0123456789") != std::string::npos) {
+                    std::cerr <<
+                        es.gr(es.BRIGHT_RED_FOREGROUND) <<
+                        "Invalid thread count " << arg << " specified with " << "-j" << "\n" <<
+                        es.gr(es.RESET_ALL);
+                    return -1;
+                }
+                auto jobs = static_cast<unsigned>(std::stoul(arg));
+                if (jobs == 0)
+                    jobs = std::max(1u, std::thread::hardware_concurrency());
+                options.jobs = jobs;
+                return 1;
+            }
+        }
+    },
+    {
+        "maxerrors",
+        argHandler {
+            " Count",
+            "Report up to N errors before stopping (default 1).",
+            [](int curArgc, int argc, char* argv[])  -> int
+            {
+                if (curArgc >= argc) {
+                    std::cerr <<
+                        es.gr(es.BRIGHT_RED_FOREGROUND) <<
+                        "No error count specified with " << "-maxerrors" << "\n" <<
+                        es.gr(es.RESET_ALL);
+                    return -1;
+                }
+                std::string arg = argv[curArgc++];
+                if (arg.empty() || arg.find_first_not_of("0123456789") != std::string::npos || std::stoul(arg) == 0) {
+                    std::cerr <<
+                        es.gr(es.BRIGHT_RED_FOREGROUND) <<
+                        "Invalid error count " << arg << " specified with " << "-maxerrors" << "\n" <<
+                        es.gr(es.RESET_ALL);
+                    return -1;
+                }
+                options.maxErrors = std::stoul(arg);
+                return 1;
+            }
+        }
+    },
+    {
+        "cache",
+        argHandler {
+            " Directory",
+            "Keep tokenized source files in a cache directory.",
+            [](int curArgc, int argc, char* argv[])  -> int
+            {
+                if (curArgc >= argc) {
+                    std::cerr <<
+                        es.gr(es.BRIGHT_RED_FOREGROUND) <<
+                        "No directory specified with " << "-cache" << "\n" <<
+                        es.gr(es.RESET_ALL);
+                    return -1;
+                }
+                options.cacheDirectory = argv[curArgc++];
+                return 1;
+            }
+        }
+    },
+    {
+        "memo",
+        argHandler {
+            "",
+            "Memoize rule parses while backtracking.",
+            [](int curArgc, int argc, char* argv[])  -> int
+            {
+                options.memoize = true;
+                return 0;
+            }
+        }
+    },
+    {
+        "nomemo",
+        argHandler {
+            "",
+            "Do not memoize rule parses while backtracking (default).",
+            [](int curArgc, int argc, char* argv[])  -> int
+            {
+                options.memoize = false;
+                return 0;
+            }
+        }
+    },
     {
         "o",
         argHandler {
@@ -37,7 +37,7 @@ void ASTNode::print(std::ostream& os, bool color, int indent, const std::string&
     auto value_color = color ? es.gr(es.GREEN_FOREGROUND) : "";
     auto reset_color = color ? es.gr(es.RESET_ALL) : "";
 
-    auto path = sourcePosition.filename;
+    auto path = sourcePosition.filename();
     std::string base_filename = path.substr(path.find_last_of("/\\") + 1);
 
     // Color the AST node name cyan and bold
@@ -24,10 +24,16 @@
 //  - `children` stores the node's operands / subexpressions. The element
 //    type `RuleArg` is typically a variant that can hold `Token`, a
 //    `std::shared_ptr<ASTNode>` or other rule-specific data.
+//  - `data` holds the packed output bytes of a DataBytes node (a .byte or
+//    .word line of literals parsed by Parser::parse_data_line); empty for
+//    every other node kind.
 //
 // The class intentionally does not manage ownership of `RuleArg` contents
 // beyond what the variant type provides; memory management for child
 // AST nodes is via `std::shared_ptr<ASTNode>` inside the children vector.
+// The parser creates nodes with makeNode (node_pool.h), which places them
+// in pooled slots reused from pass to pass; `children` and `data` still
+// allocate their elements from the heap.
 //
 // The header exposes a small printing helper `print` and a convenience
 // `add_child` method. Implementations live in `ASTNode.cpp`.
@@ -62,6 +68,9 @@ public:
     // Node children / operands. Each element is a RuleArg (variant type).
     std::vector<RuleArg> children;
 
+    // Packed output bytes (DataBytes nodes only, words stored lo, hi).
+    std::vector<uint8_t> data;
+
     // Static mapping from numeric `type` tags to human-readable names used by printers.
     static std::map<int64_t, std::string> astMap;
 
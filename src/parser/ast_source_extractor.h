@@ -17,6 +17,7 @@
 
 #include "common_types.h"
 #include "ASTNode.h"
+#include "source_text.h"
 #include "token.h"
 
 /**
@@ -32,7 +33,7 @@
  * This ordering is critical for correct retokenization.
  *
  * @param node      Root of the AST subtree to extract source from
- * @param fileCache Map: filename → vector of (SourcePos, line_text) pairs
+ * @param fileCache Map: filename → SourceText (mapped lines of the file)
  *
  * @return Sorted vector of (SourcePos, source_text) pairs suitable for retokenization
  *
@@ -51,7 +52,7 @@
 [[nodiscard]]
 inline std::vector<std::pair<SourcePos, std::string>> extractSourceFromAST(
     const std::shared_ptr<ASTNode>& node,
-    const std::map<std::string, std::vector<std::pair<SourcePos, std::string>>>& fileCache)
+    const std::map<std::string, SourceText>& fileCache)
 {
     if (!node) {
         return {};
@@ -69,7 +70,7 @@ inline std::vector<std::pair<SourcePos, std::string>> extractSourceFromAST(
 
         // Collect this node's position if valid (non-empty filename and non-zero line)
         const auto& nodePos = current->sourcePosition;
-        if (!nodePos.filename.empty() && nodePos.line > 0) {
+        if (!nodePos.filename().empty() && nodePos.line > 0) {
             positions.insert(nodePos);
         }
 
@@ -85,7 +86,7 @@ inline std::vector<std::pair<SourcePos, std::string>> extractSourceFromAST(
                 else if constexpr (std::is_same_v<T, Token>) {
                     // Extract position from Token child
                     const auto& tokenPos = arg.pos;
-                    if (!tokenPos.filename.empty() && tokenPos.line > 0) {
+                    if (!tokenPos.filename().empty() && tokenPos.line > 0) {
                         positions.insert(tokenPos);
                     }
                 }
@@ -103,7 +104,7 @@ inline std::vector<std::pair<SourcePos, std::string>> extractSourceFromAST(
     for (const SourcePos& pos : positions) {
 
         // Locate file in cache
-        auto fileIt = fileCache.find(pos.filename);
+        auto fileIt = fileCache.find(pos.filename());
         if (fileIt == fileCache.end()) {
             continue;  // File not cached, skip
         }
@@ -117,8 +118,7 @@ inline std::vector<std::pair<SourcePos, std::string>> extractSourceFromAST(
             continue;  // Line number out of bounds, skip
         }
 
-        // lines[index] is pair<SourcePos, string>; we want the string (actual source text)
-        result.emplace_back(pos, lines[index].second);
+        result.emplace_back(pos, std::string(lines.line(index)));
     }
 
     // Result is pre-sorted: std::set iteration order matches SourcePos::operator<
@@ -9,52 +9,64 @@
 //
 // Conventions:
 //  - SourcePos::line is treated as 1-based throughout the codebase.
-//  - SourcePos comparisons are ordered first by filename (lexicographically)
-//    and then by line number (ascending). This is used for deterministic
-//    sorting and stable iteration when resolving source fragments.
+//  - SourcePos stores an interned filename id. Comparisons are ordered first
+//    by filename (lexicographically) and then by line number (ascending).
+//    This is used for deterministic sorting and stable iteration when
+//    resolving source fragments.
 
 #pragma once
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <variant>
 #include <iostream>
 
+// Filename table behind SourcePos::file (implemented in source_buffer.cpp).
+// Id 0 is the empty filename.
+uint32_t internFilename(const std::string& filename);
+const std::string& filenameOf(uint32_t file);
+
 // Represents a position within a source file.
-// - `filename` is the full path or logical filename.
+// - `file` is the interned id of the full path or logical filename; use
+//   filename() for the text. Copying a SourcePos never allocates.
 // - `line` is 1-based (line == 0 means an invalid/unspecified position).
 struct SourcePos {
-    std::string filename;
+    uint32_t file;
     size_t line;
 
     // Default: unspecified position.
-    SourcePos() : filename(""), line(0) {}
+    SourcePos() : file(0), line(0) {}
 
     // Construct a position for a given file and (1-based) line number.
-    SourcePos(const std::string& f, size_t l) : filename(f), line(l) {}
+    SourcePos(const std::string& f, size_t l) : file(internFilename(f)), line(l) {}
+
+    // Full path or logical filename.
+    const std::string& filename() const { return filenameOf(file); }
 
     // Equality considers both filename and line.
-    bool operator==(const SourcePos& other) const { return filename == other.filename && line == other.line; }
+    bool operator==(const SourcePos& other) const { return file == other.file && line == other.line; }
     
     // Ordering used for sorting and containers (maps/sets).
     // Primary key: filename (lexicographic)
     // Secondary key: line (ascending)
     bool operator<(const SourcePos& other) const
     {
-        return (filename < other.filename) ||
-            (filename == other.filename && line < other.line);
+        if (file == other.file)
+            return line < other.line;
+        return filename() < other.filename();
     }
 
     // Convenience greater-than; follows the same tuple ordering semantics.
     bool operator>(const SourcePos& other) const
     {
-        return (filename > other.filename) ||
-            (filename == other.filename && line > other.line);
+        return other < *this;
     }
 
     // Print a compact representation showing only the base filename and line.
     // Example output: "[main.cpp 42]"
     void print() const
     {
-        auto path = filename;
+        auto& path = filename();
         std::string base_filename = path.substr(path.find_last_of("/\\") + 1);
         std::cout << "[" << base_filename << " " << line << "]\n";
     }
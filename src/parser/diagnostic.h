@@ -0,0 +1,54 @@
+// written by Paul Baxter
+// diagnostic.h
+//
+// Structured assembly errors.
+//
+//  - A Diagnostic holds an error code, the message and the token the error
+//    was raised at. The source lines shown around it are only formatted when
+//    it is printed (Parser::format_diagnostic).
+//  - Parser::throwError throws a ParseError carrying its Diagnostic. With
+//    maxErrors above 1 the top-level line loop catches it, records the
+//    Diagnostic and resumes after the next EOL (Parser::recover).
+#pragma once
+#include <stdexcept>
+#include <string>
+
+#include "token.h"
+
+enum class DiagCode {
+    Error,      // any other error
+    Syntax,     // tokens that do not form a line or an expression
+    Range,      // operand, branch offset or size out of range
+    Macro,      // macro definition or expansion
+    File,       // source or include file could not be read
+};
+
+// Short name of a code, as printed with the diagnostic.
+inline const char* diagCodeName(DiagCode code)
+{
+    switch (code) {
+        case DiagCode::Syntax: return "syntax";
+        case DiagCode::Range:  return "range";
+        case DiagCode::Macro:  return "macro";
+        case DiagCode::File:   return "file";
+        default:               return "error";
+    }
+}
+
+struct Diagnostic {
+    DiagCode code = DiagCode::Error;
+    std::string message;
+    Token token;    // token at the error, type INVALID at the end of input
+};
+
+// Exception thrown by Parser::throwError. what() is the message, followed by
+// the source context unless the parser collects errors.
+class ParseError : public std::runtime_error {
+public:
+    ParseError(const Diagnostic& diagnostic, const std::string& what)
+        : std::runtime_error(what), diagnostic(diagnostic)
+    {
+    }
+
+    Diagnostic diagnostic;
+};
@@ -25,13 +25,12 @@ extern Tokenizer tokenizer;
 
 namespace fs = std::filesystem;
 
-#define __ORIGINAL_OP_PROCESSOR__ 1
 // #define __DEBUG_MACROS__ 1
 
 
 static void handle_label_def(std::shared_ptr<ASTNode>& node, Parser& p, SymTable& table, const Token& tok)
 {
-    std::string name = tok.value;
+    std::string name(tok.value);
     if (name.starts_with('@')) {
         name = p.scope + name;
     }
@@ -48,11 +47,28 @@ static void handle_label_def(std::shared_ptr<ASTNode>& node, Parser& p, SymTable
 #endif
 }
 
-#ifdef __ORIGINAL_OP_PROCESSOR__
+//=============================================================================
+// Instruction operands
+//=============================================================================
+
+/// <summary>
+/// Count for an addressing mode action, tracked like parse_rule tracks the
+/// count of a rule matched at the current position.
+/// </summary>
+static int modeCount(Parser& p, RULE_TYPE mode)
+{
+    return p.ruleMatches.count(p.current_pos, mode);
+}
+
+static void recordMode(Parser& p, RULE_TYPE mode)
+{
+    p.ruleMatches.record(p.current_pos, mode);
+}
+
 static std::shared_ptr<ASTNode> processOpCodeRule(RULE_TYPE ruleType,
     const std::vector<RuleArg>& args, Parser& p, int count)
 {
-    auto node = std::make_shared<ASTNode>(ruleType, p.sourcePos);
+    auto node = makeNode(ruleType, p.sourcePos);
     node->pc_Start = p.PC;
     if (p.inMacroDefinition) {
         node->value = 0;
@@ -63,36 +79,33 @@ static std::shared_ptr<ASTNode> processOpCodeRule(RULE_TYPE ruleType,
     TOKEN_TYPE opcodeTok = static_cast<TOKEN_TYPE>(left->value);
 
     // Check if opcode is valid
-    auto it = opcodeDict.find(opcodeTok);
-    if (it == opcodeDict.end()) {
+    auto modes = opcodeModes(opcodeTok);
+    if (!modes) {
         p.throwError("Unknown opcode ");
     }
 
     // Check if opcode is valid for implied mode
-    const OpCodeInfo& info = it->second;
-    auto inf = info.mode_to_opcode.find(ruleType);
-    if (inf == info.mode_to_opcode.end()) {
+    const OpCodeInfo& info = *modes->info;
+    if (!modes->supports(ruleType)) {
         ruleType = Op_Accumulator;
-        inf = info.mode_to_opcode.find(ruleType);
     }
-    if (inf == info.mode_to_opcode.end()) {
+    if (!modes->supports(ruleType)) {
         auto& mode = p.parserDict[ruleType];
         auto mode_name = mode.substr(7);
         p.throwError("Opcode '" + info.mnemonic + "' does not support addressing mode " + mode_name);
     }
-    auto& [opcode, cycles] = inf->second;
     for (const auto& arg : args) node->add_child(arg);
     if (count == 0) {
         p.bytesInLine++;
     }
-    node->value = opcode;
+    node->value = modes->opcode(ruleType);
     return node;
 }
 
 static std::shared_ptr<ASTNode> processOpCodeRule(std::vector<RULE_TYPE> rule,
     RuleArg l, RuleArg r, Parser& p, int count)
 {
-    RULE_TYPE ruleType;
+    RULE_TYPE ruleType = (RULE_TYPE)-1;
     auto& left = std::get<std::shared_ptr<ASTNode>>(l);
     auto& right = std::get<std::shared_ptr<ASTNode>>(r);
     TOKEN_TYPE opcode = static_cast<TOKEN_TYPE>(left->value);
@@ -104,22 +117,22 @@ static std::shared_ptr<ASTNode> processOpCodeRule(std::vector<RULE_TYPE> rule,
                 ruleType = type;
                 break;
             }
-        auto node = std::make_shared<ASTNode>(ruleType, p.sourcePos);
+        auto node = makeNode(ruleType, p.sourcePos);
         node->pc_Start = p.PC;
         node->value = 0;
         return node;
     }
 
-    auto it = opcodeDict.find(opcode);
-    if (it == opcodeDict.end()) {
+    auto modes = opcodeModes(opcode);
+    if (!modes) {
         p.throwError("Unknown opcode ");
     }
 
-    const OpCodeInfo& info = it->second;
-    bool supports_two_byte = (info.mode_to_opcode.find(rule[0]) != info.mode_to_opcode.end());
-    bool supports_one_byte = (info.mode_to_opcode.find(rule[1]) != info.mode_to_opcode.end());
+    const OpCodeInfo& info = *modes->info;
+    bool supports_two_byte = modes->supports(rule[0]);
+    bool supports_one_byte = modes->supports(rule[1]);
     bool supports_relative = rule.size() == 3
-        ? (info.mode_to_opcode.find(rule[2]) != info.mode_to_opcode.end())
+        ? modes->supports(rule[2])
         : false;
     
     if (!(supports_two_byte || supports_one_byte || supports_relative)) {
@@ -137,8 +150,11 @@ static std::shared_ptr<ASTNode> processOpCodeRule(std::vector<RULE_TYPE> rule,
     bool forceLarge = (op_value == 0 && p.pass < 2) || opcode == TOKEN_TYPE::JMP;
     bool is_large = (op_value & ~0xFF) != 0 || forceLarge;
     bool out_of_range = (op_value & ~0xFFFF) != 0 || (!supports_two_byte && !supports_relative && is_large);
+    if ((op_value == 0 && p.pass < 2) || out_of_range) {
+        p.lineInputs.replayable = false;
+    }
     if (out_of_range && p.globalSymbols.changes == 0) {
-        p.throwError("Opcode '" + info.mnemonic + "' operand out of range (" + std::to_string(op_value) + ")");
+        p.throwError(DiagCode::Range, "Opcode '" + info.mnemonic + "' operand out of range (" + std::to_string(op_value) + ")");
     }
 
     int sz = 0;
@@ -147,9 +163,13 @@ static std::shared_ptr<ASTNode> processOpCodeRule(std::vector<RULE_TYPE> rule,
         if (supports_relative) {
             sz = 2;
             auto rel_value = op_value - (p.PC + 2);
+            p.lineInputs.readsPC = true;
             if (op_value != 0) {
+                if (((rel_value + 127) & ~0xFF) != 0) {
+                    p.lineInputs.replayable = false;
+                }
                 if (((rel_value + 127) & ~0xFF) != 0 && p.globalSymbols.changes == 0) {
-                    p.throwError("Opcode '" + info.mnemonic + "' operand out of range (" + std::to_string(op_value) + ")");
+                    p.throwError(DiagCode::Range, "Opcode '" + info.mnemonic + "' operand out of range (" + std::to_string(op_value) + ")");
                 }
             }
             ruleType = rule[2];
@@ -164,21 +184,251 @@ static std::shared_ptr<ASTNode> processOpCodeRule(std::vector<RULE_TYPE> rule,
             sz = 3;
         }
     }
-    auto node = std::make_shared<ASTNode>(ruleType, p.sourcePos);
+    else {
+        // out of range while symbols are still changing (otherwise it threw
+        // above): the widest mode, with no size until the operand settles
+        ruleType = supports_relative ? rule[2] : supports_two_byte ? rule[0] : rule[1];
+    }
+    if (ruleType == (RULE_TYPE)-1) {
+        p.throwError("Opcode '" + info.mnemonic + "' has no addressing mode for its operand");
+    }
+    auto node = makeNode(ruleType, p.sourcePos);
     node->pc_Start = p.PC;
 
-    auto inf = info.mode_to_opcode.find(ruleType);
-    if (inf != info.mode_to_opcode.end()) {
-        auto& [opcode, _] = inf->second;
-        node->value = opcode;
+    if (modes->supports(ruleType)) {
+        node->value = modes->opcode(ruleType);
         if (count == 0 && !p.inMacroDefinition) {
             p.bytesInLine += sz;
         }
     }
     return node;
 }
-#endif
 
+/// <summary>
+/// Operands of a mode that picks its size from the operand value
+/// (processOpCodeRule), children are the matched arguments.
+/// </summary>
+static std::shared_ptr<ASTNode> processOperandMode(RULE_TYPE mode, std::vector<RULE_TYPE> rule,
+    const std::vector<RuleArg>& args, size_t operand, Parser& p)
+{
+    int count = modeCount(p, mode);
+    auto node = processOpCodeRule(std::move(rule), args[0], args[operand], p, count);
+    for (const auto& arg : args) node->add_child(arg);
+    recordMode(p, mode);
+    return node;
+}
+
+static std::shared_ptr<ASTNode> processImpliedMode(RULE_TYPE mode, const std::vector<RuleArg>& args, Parser& p)
+{
+    int count = modeCount(p, mode);
+    auto node = processOpCodeRule(mode, args, p, count);
+    recordMode(p, mode);
+    return node;
+}
+
+static std::shared_ptr<ASTNode> processZeroPageRelative(const std::vector<RuleArg>& args, Parser& p)
+{
+    int count = modeCount(p, Op_ZeroPageRelative);
+
+    auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
+    auto& zp = std::get<std::shared_ptr<ASTNode>>(args[1]);
+    auto& rel = std::get<std::shared_ptr<ASTNode>>(args[3]);
+    TOKEN_TYPE opcode = static_cast<TOKEN_TYPE>(left->value);
+
+    auto modes = opcodeModes(opcode);
+    if (!modes) {
+        p.throwError("Unknown opcode in Op_ZeroPageRelative rule");
+    }
+    const OpCodeInfo& info = *modes->info;
+
+    if (!modes->supports(Op_ZeroPageRelative)) {
+        p.throwError("Opcode '" + info.mnemonic + "' does not support zero page relative addressing mode");
+    }
+    auto opCode = modes->opcode(Op_ZeroPageRelative);
+    int zp_addr = zp->value;
+    int target = rel->value;
+    int rel_offset = target - (p.PC + 3); // opcode + zp + rel 
+    p.lineInputs.readsPC = true;
+    if (((rel_offset + 128) & ~0xFF) != 0) {
+        p.lineInputs.replayable = false;    // only an error after pass 1
+    }
+    
+    if ((p.pass > 1) && ((rel_offset + 128) & ~0xFF) != 0) {
+        p.throwError(DiagCode::Range, "Relative branch target out of range (-128 to 127)");
+    }
+    if (zp_addr < 0 || zp_addr > 0xFF) {
+        p.throwError(DiagCode::Range, "Zero page address out of range (0-255)");
+    }
+    if (p.pass > 1 && (rel_offset < -128 || rel_offset > 127)) {
+        p.throwError(DiagCode::Range, "Relative branch target out of range (-128 to 127)");
+    }
+
+    auto node = makeNode(Op_ZeroPageRelative, p.sourcePos);
+    for (const auto& arg : args) node->add_child(arg);
+
+    // You can encode the value as needed for your backend
+    node->value = opCode;
+    if (count == 0 && !p.inMacroDefinition)
+        p.bytesInLine += 3;
+    recordMode(p, Op_ZeroPageRelative);
+    return node;
+}
+
+/// <summary>
+/// Parses the operand of an instruction in one scan and builds its addressing
+/// mode node. The punctuation around the operand expression selects the mode,
+/// in the order the modes used to be tried as grammar alternatives:
+///   A              Op_Accumulator
+///   #expr          Op_Immediate
+///   (expr,X)       Op_IndirectX
+///   (expr),Y       Op_IndirectY
+///   (expr)         Op_Indirect
+///   expr,expr      Op_ZeroPageRelative
+///   expr,X         Op_AbsoluteX / Op_ZeroPageX
+///   expr,Y         Op_AbsoluteY / Op_ZeroPageY
+///   expr           Op_Absolute / Op_ZeroPage / Op_Relative
+///   (nothing else) Op_Implied
+/// </summary>
+/// <param name="p">Parser positioned after the mnemonic.</param>
+/// <param name="opcode">The OpCode node.</param>
+static std::shared_ptr<ASTNode> parseOperand(Parser& p, const RuleArg& opcode)
+{
+    const size_t start = p.current_pos;
+    const SourcePos startSource = p.sourcePos;
+    std::vector<RuleArg> args{ opcode };
+
+    auto type = start < p.tokens.size() ? p.tokens.type(start) : TOKEN_TYPE::LAST;
+    switch (type) {
+        case A:
+            p.match_token(A, args);
+            return processImpliedMode(Op_Accumulator, args, p);
+
+        case POUND:
+            p.match_token(POUND, args);
+            if (auto expr = p.parse_rule(Expr)) {
+                args.push_back(expr);
+                return processOperandMode(Op_Immediate, { (RULE_TYPE)-1, Op_Immediate }, args, 2, p);
+            }
+            break;
+
+        case LPAREN:
+        {
+            p.match_token(LPAREN, args);
+            auto addr = p.parse_rule(AddrExpr);
+            if (!addr)
+                break;
+            args.push_back(addr);
+
+            const size_t afterAddr = p.current_pos;
+            if (p.match_token(COMMA, args) && p.match_token(X, args) && p.match_token(RPAREN, args))
+                return processOperandMode(Op_IndirectX, { Op_IndirectX, Op_IndirectX }, args, 2, p);
+
+            p.current_pos = afterAddr;
+            args.resize(3);
+            if (!p.match_token(RPAREN, args))
+                break;
+
+            const size_t afterParen = p.current_pos;
+            if (p.match_token(COMMA, args) && p.match_token(Y, args))
+                return processOperandMode(Op_IndirectY, { (RULE_TYPE)-1, Op_IndirectY }, args, 2, p);
+
+            p.current_pos = afterParen;
+            args.resize(4);
+            return processOperandMode(Op_Indirect, { Op_Indirect, Op_Indirect }, args, 2, p);
+        }
+
+        default:
+        {
+            auto expr = p.parse_rule(Expr);
+            if (!expr)
+                break;
+            const size_t afterExpr = p.current_pos;
+
+            args.push_back(expr);
+            if (p.match_token(COMMA, args)) {
+                if (auto rel = p.parse_rule(Expr)) {
+                    args.push_back(rel);
+                    return processZeroPageRelative(args, p);
+                }
+
+                // indexed operands hold an AddrExpr
+                auto index = p.current_pos < p.tokens.size() ? p.tokens.type(p.current_pos) : TOKEN_TYPE::LAST;
+                if (index == X || index == Y) {
+                    p.current_pos = start;
+                    args.resize(1);
+                    args.push_back(p.parse_rule(AddrExpr));
+                    p.match_token(COMMA, args);
+                    p.match_token(index, args);
+                    if (index == X)
+                        return processOperandMode(Op_AbsoluteX, { Op_AbsoluteX, Op_ZeroPageX }, args, 1, p);
+                    return processOperandMode(Op_AbsoluteY, { Op_AbsoluteY, Op_ZeroPageY }, args, 1, p);
+                }
+            }
+
+            p.current_pos = afterExpr;
+            args.resize(2);
+            return processOperandMode(Op_Absolute, { Op_Absolute, Op_ZeroPage, Op_Relative }, args, 1, p);
+        }
+    }
+
+    // no operand: the mnemonic alone
+    p.current_pos = start;
+    p.sourcePos = startSource;
+    args.resize(1);
+    return processImpliedMode(Op_Implied, args, p);
+}
+
+//=============================================================================
+// Comma separated lists
+//=============================================================================
+
+/// <summary>
+/// Parses the ", item" pairs following the first item of a comma separated
+/// list in a loop and returns every item as a child of one flat node. Data
+/// tables put thousands of values on a line, a right recursive production
+/// would nest one rule call and one node per value.
+/// </summary>
+/// <param name="p">Parser positioned after the first item.</param>
+/// <param name="type">Type of the list node.</param>
+/// <param name="first">The first item (matched by the list production).</param>
+/// <param name="addItem">Adds an item to the node.</param>
+/// <param name="parseItem">Parses one item into the node; false if there is none.</param>
+/// <remarks>
+/// A comma not followed by an item is left unconsumed, as the
+/// backtracking of the recursive production did.
+/// </remarks>
+template <typename AddItem, typename ParseItem>
+static std::shared_ptr<ASTNode> parseCommaList(Parser& p, RULE_TYPE type, const RuleArg& first,
+    AddItem addItem, ParseItem parseItem)
+{
+    auto node = makeNode(type, p.sourcePos);
+    node->pc_Start = p.PC;
+
+    // one item per comma left on the line
+    size_t items = 1;
+    size_t end = std::min(p.tokens.nextEOL(p.current_pos), p.tokens.size());
+    for (size_t i = p.current_pos; i < end; ++i) {
+        if (p.tokens.type(i) == COMMA)
+            ++items;
+    }
+    node->children.reserve(items);
+    addItem(*node, first);
+
+    std::vector<RuleArg> comma;
+    while (p.current_pos < p.tokens.size() && p.tokens.type(p.current_pos) == COMMA) {
+        const size_t start = p.current_pos;
+        const SourcePos startSource = p.sourcePos;
+        comma.clear();
+        p.match_token(COMMA, comma);
+        if (!parseItem(*node)) {
+            p.current_pos = start;
+            p.sourcePos = startSource;
+            break;
+        }
+    }
+    node->sourcePosition = p.sourcePos;
+    return node;
+}
 
 /// <summary
 /// Defines grammar rules and their associated semantic actions for a parser, mapping rule symbols to their production patterns and handler functions.
@@ -202,7 +452,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             [](Parser& p, const std::vector<RuleArg>& args, int count) -> std::shared_ptr<ASTNode>
             {   // Action
 
-                auto node = std::make_shared<ASTNode>(LabelDef);
+                auto node = makeNode(LabelDef);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
 
@@ -244,7 +494,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(Number, p.sourcePos);
+                auto node = makeNode(Number, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
 
@@ -254,48 +504,12 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                         const Token& tok = std::get<Token>(args[0]);
                         switch (tok.type) {
                             case DECNUM:
-                            {
-                                std::string n = tok.value.substr(0);
-                                node->value = std::stol(n, nullptr, 10);
-                                break;
-                            }
-
                             case HEXNUM:
-                            {
-                                std::string n = join_segments(tok.value.substr(1));
-                                node->value = std::stol(n, nullptr, 16);
-                                break;
-                            }
-
                             case BINNUM:
-                            {
-                                std::string n = join_segments(tok.value.substr(1));
-                                node->value = std::stol(n, nullptr, 2);
-                                break;
-                            }
-
                             case OCTNUM:
-                            {
-                                // Accept multiple common octal prefixes:
-                                // "0o123", "0O123", "o123", "&123", or plain leading '0' like "0123".
-                                std::string s = tok.value;
-                                if (s.rfind("0o", 0) == 0 || s.rfind("0O", 0) == 0) {
-                                    s = s.substr(2);
-                                }
-                                else if (!s.empty() && (s[0] == 'o' || s[0] == 'O' || s[0] == '&')) {
-                                    s = s.substr(1);
-                                }
-                                else if (s.size() > 1 && s[0] == '0') {
-                                    // "0123" style octal - strip leading 0
-                                    s = s.substr(1);
-                                }
-                                s = join_segments(s);
-                                node->value = std::stol(s, nullptr, 8);
-                                break;
-                            }
-
                             case CHAR:
-                                node->value = tok.value[1];
+                                // decoded once by the Tokenizer
+                                node->value = tok.number;
                                 break;
 
                             default:
@@ -305,7 +519,8 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                     }
                 }
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -318,7 +533,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(PCAssign, p.sourcePos);
+                auto node = makeNode(PCAssign, p.sourcePos);
                 node->pc_Start = p.PC;
 
                 for (const auto& arg : args) node->add_child(arg);
@@ -343,7 +558,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(Equate, p.sourcePos);
+                auto node = makeNode(Equate, p.sourcePos);
                 node->pc_Start = p.PC;
 
                 for (const auto& arg : args) node->add_child(arg);
@@ -351,23 +566,24 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                 std::shared_ptr<ASTNode> value = std::get<std::shared_ptr<ASTNode>>(args[2]);
                 std::shared_ptr<ASTNode> lab = std::get<std::shared_ptr<ASTNode>>(args[0]);
                 Token symtok = std::get<Token>(lab->children[0]);
+                std::string symname(symtok.value);
 
                 if (symtok.type == SYM) {
-                    if (p.varSymbols.isDefined(symtok.value)) {
+                    if (p.varSymbols.isDefined(symname)) {
                         if (count == 0 && !p.deferVariableUpdates) {
-                            p.varSymbols.setSymValue(symtok.value, p.sourcePos, value->value);
-                            auto sym = p.varSymbols.getSymValue(symtok.value, p.sourcePos);
+                            p.varSymbols.setSymValue(symname, p.sourcePos, value->value);
+                            auto sym = p.varSymbols.getSymValue(symname, p.sourcePos);
                         }
                     }
                     else {
-                        p.globalSymbols.add(symtok.value, value->value, p.sourcePos);
-                        p.globalSymbols.setSymEQU(symtok.value);
+                        p.globalSymbols.add(symname, value->value, p.sourcePos);
+                        p.globalSymbols.setSymEQU(symname);
                     }
                 }
                 else if (symtok.type == LOCALSYM) {
-                    auto symname = p.scope + symtok.value;
-                    p.localSymbols.add(symname, value->value, p.sourcePos);
-                    p.localSymbols.setSymEQU(symname);
+                    auto localname = p.scope + symname;
+                    p.localSymbols.add(localname, value->value, p.sourcePos);
+                    p.localSymbols.setSymEQU(localname);
                 }
                 node->value = value->value;
                 return node;
@@ -394,7 +610,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(Factor, p.sourcePos);
+                auto node = makeNode(Factor, p.sourcePos);
                 node->pc_Start = p.PC;
 
                 for (const auto& arg : args) node->add_child(arg);
@@ -407,6 +623,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                             auto tok = std::get<Token>(args[0]);
                             if (tok.type == MUL) {
                                 node->value = p.PC;
+                                p.lineInputs.readsPC = true;
                             }
                             else if (tok.type == MACRO_PARAM) {
                                 node->value = 1;
@@ -464,11 +681,12 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                         break;
                     }
                     default:
-                        p.throwError("Syntax error in Factor rule");
+                        p.throwError(DiagCode::Syntax, "Syntax error in Factor rule");
                 }
 
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -481,7 +699,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(EndMacro, p.sourcePos);
+                auto node = makeNode(EndMacro, p.sourcePos);
                 node->pc_Start = p.PC;
 
                 for (const auto& arg : args) node->add_child(arg);
@@ -493,348 +711,26 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
         }
     },
 
-    // MulExpr (multiply expression)
-    {
-        MulExpr,
-        RuleHandler {
-            {
-                { MulExpr, -Factor }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = std::make_shared<ASTNode>(MulExpr, p.sourcePos);
-                node->pc_Start = p.PC;
-
-                for (const auto& arg : args) node->add_child(arg);
-
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                auto child =
-                p.handle_binary_operation(
-                    left,
-                    {MUL, DIV, MOD},
-                    MulExpr,
-                    [&p]()
-                    {
-                        return p.parse_rule(Factor);
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r)
-                    {
-                        if ((op == DIV || op == MOD) && r == 0) {
-                            p.throwError("Division by zero");
-                        }
-                        return
-                            (op == MOD)
-                            ? l % r
-                            :
-                                ((op == MUL)
-                                ? l * r
-                                : l / r);
-                    },
-                    "a factor"
-                );
-                node->add_child(child);
-                node->value = child->value;
-                return node;
-            }
-        }
-    },
-
-    // AddExpr (add expression)
-    {
-        AddExpr,
-        RuleHandler {
-            {
-                { AddExpr, -MulExpr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = std::make_shared<ASTNode>(AddExpr, p.sourcePos);
-                node->pc_Start = p.PC;
-
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                auto child =
-                p.handle_binary_operation(
-                    left,
-                    { PLUS, MINUS },
-                    AddExpr,
-                    [&p]()
-                    {
-                        auto node = p.parse_rule(MulExpr);
-                        return node;
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r)
-                    {
-                        return op == PLUS ? l + r : l - r;
-                    },
-                    "a term"
-                );
-                node->value = child->value;
-                node->add_child(child);
-                return node;
-            }
-        }
-    },
-
-    // ShiftExpr (shift expression)
-    {
-        ShiftExpr,
-        RuleHandler {
-            {
-                { ShiftExpr, -AddExpr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = std::make_shared<ASTNode>(ShiftExpr, p.sourcePos);
-                node->pc_Start = p.PC;
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                auto child = p.handle_binary_operation(
-                    left,
-                    { SLEFT, SRIGHT },
-                    ShiftExpr,
-                    [&p]()
-                    {
-                        return p.parse_rule(AddExpr);
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r)
-                    {
-                        return op == SLEFT ? l << r : l >> r;
-                    },
-                    "a term"
-                );
-                node->add_child(child);
-                node->value = child->value;
-                return node;
-            }
-        }
-    },
-
-    // RelExpr (relational expression: <, >, <=, >=)
-    {
-        RelExpr,
-        RuleHandler {
-            {
-                { RelExpr, -ShiftExpr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = std::make_shared<ASTNode>(RelExpr, p.sourcePos);
-                node->pc_Start = p.PC;
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                auto child = p.handle_binary_operation(
-                    left,
-                    { LT, GT, LE, GE },
-                    RelExpr,
-                    [&p]()
-                    {
-                        return p.parse_rule(ShiftExpr);
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r) -> int
-                    {
-                        switch (op) {
-                            case LT: return (l < r) ? 1 : 0;
-                            case GT: return (l > r) ? 1 : 0;
-                            case LE: return (l <= r) ? 1 : 0;
-                            case GE: return (l >= r) ? 1 : 0;
-                            default: return 0;
-                        }
-                    },
-                    "a shift expression"
-                );
-                node->add_child(child);
-                node->value = child->value;
-                return node;
-            }
-        }
-    },
-
-    // EqExpr (equality expression: ==, !=)
-    {
-        EqExpr,
-        RuleHandler {
-            {
-                { EqExpr, -RelExpr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = std::make_shared<ASTNode>(EqExpr, p.sourcePos);
-                node->pc_Start = p.PC;
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                auto child = p.handle_binary_operation(
-                    left,
-                    { DEQUAL, NOTEQUAL },
-                    EqExpr,
-                    [&p]()
-                    {
-                        return p.parse_rule(RelExpr);
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r) -> int
-                    {
-                        return (op == DEQUAL) ? ((l == r) ? 1 : 0) : ((l != r) ? 1 : 0);
-                    },
-                    "a relational expression"
-                );
-                node->add_child(child);
-                node->value = child->value;
-                return node;
-            }
-        }
-    },
-
-    // AndExpr (bitwise AND) - MODIFIED: now parses EqExpr
-    {
-        AndExpr,
-        RuleHandler{
-            {
-                { AndExpr, -EqExpr }  // Changed from -ShiftExpr
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                return p.handle_binary_operation(
-                    left,
-                    {BIT_AND},
-                    AndExpr,
-                    [&p]()
-                    {
-                        return p.parse_rule(EqExpr);  // Changed from ShiftExpr
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r) {
-                        return l & r; 
-                    },
-                    "an equality expression"
-                );
-            }
-        }
-    },
-
-    // XOrExpr
-    {
-        XOrExpr,
-        RuleHandler{
-            {
-                { XOrExpr, -AndExpr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                return p.handle_binary_operation(
-                    left,
-                    {BIT_XOR},
-                    XOrExpr,
-                    [&p]()
-                    {
-                        auto node = p.parse_rule(AndExpr);
-                        return node;
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r) { return l ^ r; },
-                    "an or expression"
-                );
-            }
-        }
-    },
-
-    // OrExpr
-    {
-        OrExpr,
-        RuleHandler {
-            {
-                { OrExpr, -XOrExpr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                return p.handle_binary_operation(
-                    left,
-                    { BIT_OR },
-                    OrExpr,
-                    [&p]()
-                    {
-                        auto node = p.parse_rule(XOrExpr);
-                        return node;
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r) { return l | r; },
-                    "an or expression"
-                );
-            }
-        }
-    },
-
-    // LogicalAndExpr
-    {
-        LogicalAndExpr,
-        RuleHandler {
-            {
-                { LogicalAndExpr, -OrExpr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                return p.handle_binary_operation(
-                    left,
-                    { LOGICAL_AND },
-                    LogicalAndExpr,
-                    [&p]()
-                    {
-                        auto node = p.parse_rule(OrExpr);
-                        return node;
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r)
-                    {
-                        return l && r ? 1 : 0;
-                    },
-                    "a logical and expression"
-                );
-            }
-        }
-    },
-
-    // LogicalOrExpr
-    {
-        LogicalOrExpr,
-        RuleHandler {
-            {
-                { LogicalOrExpr, -LogicalAndExpr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                return p.handle_binary_operation(
-                    left,
-                    { LOGICAL_OR },
-                    LogicalOrExpr,
-                    [&p]()
-                    {
-                        auto node = p.parse_rule(LogicalAndExpr);
-                        return node;
-                    },
-                    [&p](int l, TOKEN_TYPE op, int r)
-                    {
-                        return l || r ? 1 : 0;
-                    },
-                    "a logical or expression"
-                );
-            }
-        }
-    },
-
     // Expr
     {
         Expr,
         RuleHandler{
             {
-                { Expr, -LogicalOrExpr },
+                { Expr, -Factor },
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(Expr, p.sourcePos);
-                node->pc_Start = p.PC;
-
-                // uncomment if you want Expr detail
-                // for (const auto& arg : args) node->add_child(arg);
+                // the binary operators following the first Factor are parsed
+                // by precedence climbing (Parser::parse_operators)
                 auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                node->value = left->value;
+                auto value = p.parse_operators(left->value, 1);
+
+                auto node = makeNode(Expr, p.sourcePos);
+                node->pc_Start = p.PC;
+                node->value = value;
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -965,7 +861,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
                 const Token& tok = std::get<Token>(args[0]);
-                auto node = std::make_shared<ASTNode>(OpCode, p.sourcePos);
+                auto node = makeNode(OpCode, p.sourcePos);
                 node->pc_Start = p.PC;
 
                 for (const auto& arg : args) node->add_child(arg);
@@ -978,7 +874,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                         // Check if opcode is valid
                         auto it = opcodeDict.find(opcode);
                         if (it == opcodeDict.end()) {
-                            p.throwError("Unknown opcode " + tok.value);
+                            p.throwError("Unknown opcode " + std::string(tok.value));
                         }
                         break;
                     }
@@ -988,215 +884,11 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                         break;
                 }
                 return node;
-            }
-        },
-    },
-
-#ifdef __ORIGINAL_OP_PROCESSOR__
-    // Op_Implied
-    {
-        Op_Implied,
-        RuleHandler {
-            {
-                { Op_Implied, -OpCode }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = processOpCodeRule(Op_Implied, args, p, count);
-                return node;
-            }
-        }
-    },
-
-    // Op_Accumulator
-    {
-        Op_Accumulator,
-        RuleHandler {
-            {
-                { Op_Accumulator, -OpCode, A }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                return processOpCodeRule(Op_Accumulator, args, p, count);
-            }
-        }
-    },
-
-    // Op_Immediate
-    {
-        Op_Immediate,
-        RuleHandler{
-            {
-                { Op_Immediate, -OpCode, POUND, -Expr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = processOpCodeRule(std::vector<RULE_TYPE> {(RULE_TYPE)-1, Op_Immediate },
-                    args[0], args[2], p, count);
-                for (const auto& arg : args) node->add_child(arg);
-
-                return node;
-            }
-        }
-    },
-
-    // Op_Absolute
-    {
-        Op_Absolute,
-        RuleHandler{
-            {
-                { Op_Absolute, -OpCode, -Expr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = processOpCodeRule(std::vector<RULE_TYPE> {Op_Absolute, Op_ZeroPage, Op_Relative},
-                    args[0], args[1], p, count);
-                for (const auto& arg : args) node->add_child(arg);
-                return node;
-            }
-        }
-    },
-
-    // Op_AbsoluteX
-    {
-        Op_AbsoluteX,
-        RuleHandler {
-            {
-                { Op_AbsoluteX, -OpCode, -AddrExpr, COMMA, X }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = processOpCodeRule(std::vector<RULE_TYPE> {Op_AbsoluteX, Op_ZeroPageX},
-                    args[0], args[1], p, count);
-                for (const auto& arg : args) node->add_child(arg);
-                return node;
-            }
-        }
-    },
-
-    // Op_AbsoluteY
-    {
-        Op_AbsoluteY,
-        RuleHandler {
-            {
-                { Op_AbsoluteY, -OpCode, -AddrExpr, COMMA, Y }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = processOpCodeRule(std::vector<RULE_TYPE> {Op_AbsoluteY, Op_ZeroPageY},
-                    args[0], args[1], p, count);
-                for (const auto& arg : args) node->add_child(arg);
-                return node;
-            }
-        }
-    },
-
- 
-    // Op_Indirect
-    {
-        Op_Indirect,
-        RuleHandler{
-            {
-                { Op_Indirect, -OpCode, LPAREN, -AddrExpr, RPAREN }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {          
-                auto node = processOpCodeRule(std::vector<RULE_TYPE> {Op_Indirect, Op_Indirect},
-                    args[0], args[2], p, count);
-                for (const auto& arg : args) node->add_child(arg);
-                return node;
-            }
-        }
-    },
-
-    // Op_IndirectX
-    {
-        Op_IndirectX,
-        RuleHandler{
-            {
-                { Op_IndirectX, -OpCode, LPAREN, -AddrExpr, COMMA, X, RPAREN }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = processOpCodeRule(std::vector<RULE_TYPE> {Op_IndirectX, Op_IndirectX},
-                    args[0], args[2], p, count);
-                for (const auto& arg : args) node->add_child(arg);
-                return node;
-            }
-        }
-    },
-
-    // Op_IndirectY
-    {
-        Op_IndirectY,
-        RuleHandler{
-            {
-                { Op_IndirectY, -OpCode, LPAREN, -AddrExpr, RPAREN, COMMA, Y }
             },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto node = processOpCodeRule(std::vector<RULE_TYPE> {(RULE_TYPE)-1, Op_IndirectY},
-                    args[0], args[2], p, count);
-                for (const auto& arg : args) node->add_child(arg);
-                return node;
-            }
+            PURE_RULE
         }
     },
 
-    // Op_ZeroPageRelative
-    {
-        Op_ZeroPageRelative,
-        RuleHandler{
-            {
-                { Op_ZeroPageRelative, -OpCode, -Expr, COMMA, -Expr }
-            },
-            [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
-            {
-                auto& left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                auto& zp = std::get<std::shared_ptr<ASTNode>>(args[1]);
-                auto& rel = std::get<std::shared_ptr<ASTNode>>(args[3]);
-                TOKEN_TYPE opcode = static_cast<TOKEN_TYPE>(left->value);
-
-                auto it = opcodeDict.find(opcode);
-                if (it == opcodeDict.end()) {
-                    p.throwError("Unknown opcode in Op_ZeroPageRelative rule");
-                }
-                const OpCodeInfo& info = it->second;
-                auto inf = info.mode_to_opcode.find(Op_ZeroPageRelative);
-
-                if (inf == info.mode_to_opcode.end()) {
-                    p.throwError("Opcode '" + info.mnemonic + "' does not support zero page relative addressing mode");
-                }
-                auto& entry = inf->second;
-                auto& [opCode, _] = entry;
-                int zp_addr = zp->value;
-                int target = rel->value;
-                int rel_offset = target - (p.PC + 3); // opcode + zp + rel 
-                
-                if ((p.pass > 1) && ((rel_offset + 128) & ~0xFF) != 0) {
-                    p.throwError("Relative branch target out of range (-128 to 127)");
-                }
-                if (zp_addr < 0 || zp_addr > 0xFF) {
-                    p.throwError("Zero page address out of range (0-255)");
-                }
-                if (p.pass > 1 && (rel_offset < -128 || rel_offset > 127)) {
-                    p.throwError("Relative branch target out of range (-128 to 127)");
-                }
-
-                auto node = std::make_shared<ASTNode>(Op_ZeroPageRelative, p.sourcePos);
-                for (const auto& arg : args) node->add_child(arg);
-
-                // You can encode the value as needed for your backend
-                node->value = opCode;
-                if (count == 0 && !p.inMacroDefinition)
-                    p.bytesInLine += 3;
-                return node;
-            }
-        }
-    }, 
-
-#endif
-
     // AddrExpr
     {
         AddrExpr,
@@ -1206,11 +898,12 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(AddrExpr, p.sourcePos);
+                auto node = makeNode(AddrExpr, p.sourcePos);
                 auto left = std::get<std::shared_ptr<ASTNode>>(args[0]);
                 node->value = left->value;
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -1219,25 +912,17 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
         Op_Instruction,
         RuleHandler{
             {
-                { Op_Instruction, -Op_Accumulator },
-                { Op_Instruction, -Op_Immediate },
-                { Op_Instruction, -Op_IndirectX },
-                { Op_Instruction, -Op_IndirectY },
-                { Op_Instruction, -Op_Indirect },
-                { Op_Instruction, -Op_ZeroPageRelative },
-                { Op_Instruction, -Op_AbsoluteX },
-                { Op_Instruction, -Op_AbsoluteY },
-                { Op_Instruction, -Op_Absolute },
-                { Op_Instruction, -Op_Implied },
+                { Op_Instruction, -OpCode },
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(Op_Instruction, p.sourcePos);
-                node->pc_Start = p.PC;
+                // the operand is classified in one scan (parseOperand)
+                auto mode = parseOperand(p, args[0]);
 
-                for (const auto& arg : args) node->add_child(arg);
-                auto left = std::get<std::shared_ptr<ASTNode>>(args[0]);
-                node->value = left->value;
+                auto node = makeNode(Op_Instruction, p.sourcePos);
+                node->pc_Start = p.PC;
+                node->add_child(mode);
+                node->value = mode->value;
                 return node;
             }
         }
@@ -1252,7 +937,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(Comment, p.sourcePos);
+                auto node = makeNode(Comment, p.sourcePos);
                 node->pc_Start = p.PC;
 
                 for (const auto& arg : args) node->add_child(arg);
@@ -1260,7 +945,8 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                 const Token& tok = std::get<Token>(args[0]);
                 node->value = 0;
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -1273,7 +959,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(MacroStart, p.sourcePos);
+                auto node = makeNode(MacroStart, p.sourcePos);
                 node->value = 0;
                 node->pc_Start = p.PC;
 
@@ -1293,7 +979,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int /*count*/) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(SymbolName, p.sourcePos);
+                auto node = makeNode(SymbolName, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
 
@@ -1301,7 +987,8 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                 node->sourcePosition = tok.pos;
                 node->value = 0;
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -1315,31 +1002,23 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(SymbolRef, p.sourcePos);
+                auto node = makeNode(SymbolRef, p.sourcePos);
                 node->pc_Start = p.PC;
                 const Token& tok = std::get<Token>(args[0]);
-                std::string name = tok.value;
 
-                int val = 0;
-
-                if (p.varSymbols.isDefined(name)) {
-                    // FIX: variables are runtime values; ignore source position when reading
-                    val = p.varSymbols[name].value;
+                bool found;
+                int val = p.lookup_symbol(tok, found);
+                if (found) {
                     node->add_child(tok);      // keep the original token as child
                 }
-                else if (tok.type == LOCALSYM) {
-                    auto symname = p.scope + name;
-                    val = p.localSymbols.getSymValue(symname, tok.pos);
-                    node->add_child(tok);      // keep the original token as child
-                }
-                else if (p.globalSymbols.isDefined(name)) {
-                    val = p.globalSymbols.getSymValue(name, tok.pos);
-                    node->add_child(tok);      // keep the original token as child
+                if (p.lineInputs.tracing) {
+                    p.lineInputs.symbols.push_back({ tok, val, found });
                 }
                 node->sourcePosition = tok.pos;
                 node->value = val;
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -1352,7 +1031,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(MacroDef, p.sourcePos);
+                auto node = makeNode(MacroDef, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
 
@@ -1362,7 +1041,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                 auto endm = std::get<std::shared_ptr<ASTNode>>(args[4]);
 
                 Token nameTok = std::get<Token>(sym->children[0]);
-                std::string macroName = nameTok.value;
+                std::string macroName(nameTok.value);
 
                 node->sourcePosition = startm->sourcePosition;
 
@@ -1371,7 +1050,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
 
                 // Check for recursive macro definition
                 if (p.currentMacros.contains(macroName)) {
-                    p.throwError("Recursive macro definition: " + macroName);
+                    p.throwError(DiagCode::Macro, "Recursive macro definition: " + macroName);
                 }
 
                 // Extract raw text lines   
@@ -1396,21 +1075,21 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(MacroCall, p.sourcePos);
+                auto node = makeNode(MacroCall, p.sourcePos);
                 if (count == 0)
                     node->pc_Start = p.PC;
                 
                 if (p.macroCallDepth > 100) {
-                    p.throwError("Macro recursion depth exceeded (possible infinite recursion)");
+                    p.throwError(DiagCode::Macro, "Macro recursion depth exceeded (possible infinite recursion)");
                 }
 
                 auto nameNode = std::get<std::shared_ptr<ASTNode>>(args[0]);
                 Token nameTok = std::get<Token>(nameNode->children[0]);
                 node->sourcePosition = nameTok.pos;
-                std::string macroName = nameTok.value;
+                std::string macroName(nameTok.value);
 
                 if (!p.macroTable.count(macroName)) {
-                    p.throwError("Unknown macro: " + macroName);
+                    p.throwError(DiagCode::Macro, "Unknown macro: " + macroName);
                 }
  
                 // Copy macro body and expand parameters
@@ -1476,7 +1155,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                     // Ensure cleanup before propagating
                     p.currentMacros.erase(macroName);
                     p.macroCallDepth--;
-                    p.throwError(std::string("In macro '") + macroName + "': " + e.what());
+                    p.throwError(DiagCode::Macro, std::string("In macro '") + macroName + "': " + e.what());
                 }
 
                 node->value = nameTok.pos.line;
@@ -1511,20 +1190,15 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                     p.current_pos = eolpos - 1;
                     auto pos = p.current_pos;
 
-                    // Read the included file
-                    std::vector<std::pair<SourcePos, std::string>> includedLines = p.readfile(filename);
-
-                    auto inctokens = tokenizer.tokenize(includedLines);
-                    Token eolTok;
-                    eolTok.type = TOKEN_TYPE::EOL;
-                    inctokens.insert(inctokens.begin(), eolTok);
+                    // Read and tokenize the included file (cached across passes)
+                    auto& inctokens = p.includeTokens(filename);
 
                     // Insert included tokens at current position
                     p.InsertTokens(pos + 1, inctokens);
                 }
 
                 // Return a dummy node - this directive is transparent to the AST
-                auto node = std::make_shared<ASTNode>(IncludeDirective, p.sourcePos);
+                auto node = makeNode(IncludeDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 node->value = 0;
                 node->sourcePosition = incTok.pos;
@@ -1534,43 +1208,55 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
         }
     },
 
-    // Expression List (for macro arguments)
+    // Expression List (for macro arguments and .byte/.word data)
+    // The items after the first are parsed by parseCommaList: one flat
+    // ExprList node whose children are the Exprs (a TEXT item adds one Expr
+    // per character).
     {
         ExprList,
         RuleHandler{
             {
-                { ExprList, -Expr, COMMA, -ExprList },
-                { ExprList, TEXT, COMMA, -ExprList },
                 { ExprList, -Expr },
                 { ExprList, TEXT },
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(ExprList, p.sourcePos);
-                node->pc_Start = p.PC;
-                for (auto arg : args) {
-                    if (std::holds_alternative<Token>(arg)) {
-                        const Token& tok = std::get<Token>(arg);
-                        if (tok.type == TEXT) {
-                            std::vector<uint8_t> chars;
-                            chars.clear();
-                            sanitizeString(tok.value, chars);
-                            for (auto ch : chars) {
-                                auto child = std::make_shared<ASTNode>(Expr, p.sourcePos);
-                                child->value = ch;
-                                node->add_child(child);
+                auto addItem = [&p](ASTNode& node, const RuleArg& arg)
+                    {
+                        if (std::holds_alternative<Token>(arg)) {
+                            const Token& tok = std::get<Token>(arg);
+                            if (tok.type == TEXT) {
+                                std::vector<uint8_t> chars;
+                                sanitizeString(tok.value, chars);
+                                for (auto ch : chars) {
+                                    auto child = makeNode(Expr, p.sourcePos);
+                                    child->value = ch;
+                                    node.add_child(child);
+                                }
+                                return;
                             }
                         }
-                        else {
-                            node->add_child(arg);
+                        node.add_child(arg);
+                    };
+
+                std::vector<RuleArg> text;
+                auto parseItem = [&p, &addItem, &text](ASTNode& node)
+                    {
+                        if (auto expr = p.parse_rule(Expr)) {
+                            addItem(node, expr);
+                            return true;
                         }
-                    }
-                    else {
-                        node->add_child(arg);
-                    }
-                }
-                return node;
-            }
+                        text.clear();
+                        if (p.match_token(TEXT, text)) {
+                            addItem(node, text.back());
+                            return true;
+                        }
+                        return false;
+                    };
+
+                return parseCommaList(p, ExprList, args[0], addItem, parseItem);
+            },
+            PURE_RULE
         }
     },
 
@@ -1584,28 +1270,35 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const std::vector<RuleArg>& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(VarItem, p.sourcePos);
+                auto node = makeNode(VarItem, p.sourcePos);
                 for (const auto& arg : args) node->add_child(arg);
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
     // VarList - comma-separated list of variable declarations
+    // (one flat node, the items after the first are parsed by parseCommaList)
     {
         VarList,
         RuleHandler{
             {
-                { VarList, -VarItem, COMMA, -VarList },  // item, more items
-                { VarList, -VarItem },                   // base case: single item
+                { VarList, -VarItem },
             },
             [](Parser& p, const std::vector<RuleArg>& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(VarList, p.sourcePos);
-                node->pc_Start = p.PC;
-                for (const auto& arg : args) node->add_child(arg);
-                return node;
-            }
+                auto addItem = [](ASTNode& node, const RuleArg& arg) { node.add_child(arg); };
+                auto parseItem = [&p](ASTNode& node)
+                    {
+                        auto item = p.parse_rule(VarItem);
+                        if (item)
+                            node.add_child(item);
+                        return item != nullptr;
+                    };
+                return parseCommaList(p, VarList, args[0], addItem, parseItem);
+            },
+            PURE_RULE
         }
     },
 
@@ -1618,7 +1311,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(FillDirective, p.sourcePos);
+                auto node = makeNode(FillDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
 
@@ -1675,7 +1368,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(ByteDirective, p.sourcePos);
+                auto node = makeNode(ByteDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
                 auto sz = 0;
@@ -1707,7 +1400,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(WordDirective, p.sourcePos);
+                auto node = makeNode(WordDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
                 auto sz = 0;
@@ -1739,7 +1432,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(StorageDirective, p.sourcePos);
+                auto node = makeNode(StorageDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
                 const auto& tok = std::get<Token>(args[0]);
@@ -1763,7 +1456,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(OrgDirective, p.sourcePos);
+                auto node = makeNode(OrgDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
                 const auto& tok = std::get<Token>(args[0]);
@@ -1793,17 +1486,18 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const std::vector<RuleArg>& args, int /*count*/) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(IfDirective, p.sourcePos);
+                auto node = makeNode(IfDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
                 if (p.inMacroDefinition) {
+                    // skip the whole block, nested conditionals included
                     auto foundEndInf = p.current_pos;
-                    for (size_t i = p.current_pos; i < p.tokens.size(); ++i) {
-                        if (p.tokens[i].type == TOKEN_TYPE::ENDIF_DIR) {
-                            foundEndInf = i;  // Found our matching .endif
-                            break;
-                        }
-                    }
+                    auto opener = p.FindConditionalOpener(p.current_pos);
+                    auto next = p.tokens.partner(opener);
+                    if (next != TokenStore::npos && p.tokens.type(next) == TOKEN_TYPE::ELSE_DIR)
+                        next = p.tokens.partner(next);
+                    if (next != TokenStore::npos)
+                        foundEndInf = next;  // Found our matching .endif
                     p.current_pos = foundEndInf + 1;
                     return node;
                 }
@@ -1823,7 +1517,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                     {
                         auto& nameNode = std::get<std::shared_ptr<ASTNode>>(args[1]);
                         Token nameTok = std::get<Token>(nameNode->children[0]);
-                        cond = p.IsSymbolDefined(nameTok.value);
+                        cond = p.IsSymbolDefined(std::string(nameTok.value));
                         break;
                     }
 
@@ -1831,7 +1525,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                     {
                         auto& nameNode = std::get<std::shared_ptr<ASTNode>>(args[1]);
                         Token nameTok = std::get<Token>(nameNode->children[0]);
-                        cond = !p.IsSymbolDefined(nameTok.value);
+                        cond = !p.IsSymbolDefined(std::string(nameTok.value));
                         break;
                     }
 
@@ -1860,7 +1554,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(DoDirective, p.sourcePos);
+                auto node = makeNode(DoDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
 
@@ -1879,7 +1573,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(WhileDirective, p.sourcePos);
+                auto node = makeNode(WhileDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
                 node->value = WHILE_DIR;
@@ -1897,7 +1591,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const std::vector<RuleArg>& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(VarDirective, p.sourcePos);
+                auto node = makeNode(VarDirective, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
 
@@ -1906,7 +1600,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                     auto registerVar = [&p](const std::shared_ptr<ASTNode>& item)
                     {
                         const Token& symTok = std::get<Token>(item->children[0]);
-                        std::string name = symTok.value;
+                        std::string name(symTok.value);
                         int value = 0;
 
                         // children: [SYM] or [SYM, EQUAL, Expr]
@@ -1924,25 +1618,11 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                         }
                     };
 
-                    // Recursively walk VarList to process all VarItems
-                    std::function<void(const std::shared_ptr<ASTNode>&)> processVarList;
-                    processVarList = [&](const std::shared_ptr<ASTNode>& listNode)
-                    {
-                        for (const auto& child : listNode->children) {
-                            if (std::holds_alternative<std::shared_ptr<ASTNode>>(child)) {
-                                auto& childNode = std::get<std::shared_ptr<ASTNode>>(child);
-                                if (childNode->type == VarItem) {
-                                    registerVar(childNode);
-                                }
-                                else if (childNode->type == VarList) {
-                                    processVarList(childNode);
-                                }
-                            }
-                        }
-                    };
-
+                    // VarList is flat: every child is a VarItem
                     auto& varList = std::get<std::shared_ptr<ASTNode>>(args[1]);
-                    processVarList(varList);
+                    for (const auto& child : varList->children) {
+                        registerVar(std::get<std::shared_ptr<ASTNode>>(child));
+                    }
                 }
                 return node;
             }
@@ -1959,7 +1639,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int /*count*/) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(PrintDirective, p.sourcePos);
+                auto node = makeNode(PrintDirective, p.sourcePos);
                 node->value = 1;
                 node->add_child(args[0]); // token first
 
@@ -1992,7 +1672,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(Statement, p.sourcePos);
+                auto node = makeNode(Statement, p.sourcePos);
                 node->pc_Start = p.PC;
                 for (const auto& arg : args) node->add_child(arg);
                 auto left = std::get<std::shared_ptr<ASTNode>>(args[0]);
@@ -2014,7 +1694,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int /*count*/) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(PlusRun, p.sourcePos);
+                auto node = makeNode(PlusRun, p.sourcePos);
                 if (args.size() == 2) {
                     auto tail = std::get<std::shared_ptr<ASTNode>>(args[1]);
                     node->value = 1 + tail->value;
@@ -2027,7 +1707,8 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                     node->add_child(args[0]); // token first
                 }
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -2041,7 +1722,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int /*count*/) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(MinusRun, p.sourcePos);
+                auto node = makeNode(MinusRun, p.sourcePos);
                 if (args.size() == 2) {
                     auto tail = std::get<std::shared_ptr<ASTNode>>(args[1]);
                     node->value = 1 + tail->value;
@@ -2054,7 +1735,8 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                     node->add_child(args[0]); // token first
                 }
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -2074,13 +1756,14 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                 const Token& first = std::get<Token>(run->children[0]);
 
                 // FIX: Create node with the token's position, not p.sourcePos
-                auto node = std::make_shared<ASTNode>(AnonLabelRef, first.pos);
+                auto node = makeNode(AnonLabelRef, first.pos);
 
                 bool forward = (first.type == PLUS);
                 int n = run->value;
 
                 // FIX: Use first.pos (the token's actual position) for the lookup
                 auto result = p.anonLabels.find(first.pos, forward, n);
+                p.lineInputs.replayable = false;    // anchors move with PC
                 if (result.has_value()) {
                     auto& value = result.value();
                     node->value = std::get<1>(value); // anchor address
@@ -2093,7 +1776,8 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                 }
                 node->add_child(run);
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -2107,7 +1791,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(EOLOrComment);
+                auto node = makeNode(EOLOrComment);
                 node->pc_Start = p.PC;
 
                 for (const auto& arg : args) node->add_child(arg);
@@ -2117,7 +1801,8 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
                 node->sourcePosition = eolTok.pos;
                 node->value = eolTok.pos.line;
                 return node;
-            }
+            },
+            PURE_RULE
         }
     },
 
@@ -2133,32 +1818,9 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                p.PC += p.bytesInLine;
-                p.bytesInLine = 0;
-               
-                while (static_cast<int>(p.PCHistory.size()) < p.pass) {
-                    p.PCHistory.push_back(std::vector<int>());
-                }
-                assert(p.pass > 0);
-
-                p.PCHistory[p.pass - 1].push_back(p.PC);
-                auto line = static_cast<int>(p.PCHistory[p.pass -1].size());
-
-#ifdef __SHOW_SYM_CHANGE__
-                if (p.pass > 1) {
-                    auto oldv = p.PCHistory[p.pass - 2][line - 1];
-                    auto newv = p.PCHistory[p.pass - 1][line - 1];
-                    std::string change = ((oldv != newv) ? "CHANGE " : "");
-
-                    std::cout << std::setfill(' ') << std::setw(10) << change
-                        << "Line "
-                        << std::dec << std::setfill(' ') << std::setw(4) << line << " "
-                        << "$" << std::hex << std::setfill('0') << std::setw(4) << oldv << " => "
-                        << "$" << std::hex << std::setfill('0') << std::setw(4) << newv << "\n"
-                        << std::setw(0) << std::dec;
-                }
-#endif
-                auto node = std::make_shared<ASTNode>(Line);
+                p.end_line();
+
+                auto node = makeNode(Line);
                 node->pc_Start = p.PC;
 
                 for (const auto& arg : args) node->add_child(arg);
@@ -2182,7 +1844,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(LineList, p.sourcePos);
+                auto node = makeNode(LineList, p.sourcePos);
                 node->pc_Start = p.PC;
 
                 if (args.size() == 2) {
@@ -2217,7 +1879,7 @@ const std::unordered_map<int64_t, RuleHandler> grammar_rules =
             },
             [](Parser& p, const auto& args, int count) -> std::shared_ptr<ASTNode>
             {
-                auto node = std::make_shared<ASTNode>(Prog, p.sourcePos);
+                auto node = makeNode(Prog, p.sourcePos);
                 node->pc_Start = p.PC;
                 auto lineListNode = std::get<std::shared_ptr<ASTNode>>(args[0]);
                 if (lineListNode) {
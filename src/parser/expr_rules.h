@@ -27,6 +27,9 @@
 
 enum RULE_TYPE {
     // Primary expression building blocks
+    // (MulExpr, AddExpr, ShiftExpr, RelExpr, EqExpr, AndExpr, XOrExpr, OrExpr,
+    // LogicalAndExpr and LogicalOrExpr only name operator precedence levels;
+    // Expr parses the operators with Parser::parse_operators)
     Factor = 10000,
     Number,
     MulExpr,
@@ -103,6 +106,7 @@ enum RULE_TYPE {
 
     // Collections and wrappers
     ExprList,
+    DataBytes,  // Packed bytes of a literal-only .byte/.word line
     LineList,
     TokenNode,
     Prog,
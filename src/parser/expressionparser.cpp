@@ -8,6 +8,7 @@
 
 #include "ExpressionParser.h"
 #include "ANSI_esc.h"
+#include "token_cache.h"
 #include "tokenizer.h"
 
 namespace fs = std::filesystem;
@@ -31,6 +32,8 @@ void ExpressionParser::TestParserDict() const
             parser->throwError("missing parserdict entry for " + std::to_string(ruleId));
         }
     }
+
+    reportGrammarConflicts(std::cout, parserDict);
 #endif // DEBUG
 }
 
@@ -39,8 +42,23 @@ void ExpressionParser::TestParserDict() const
 /// <param name="node">A shared pointer reference to the AST node from which to extract expression values.</param>
 /// <param name="data">A reference to a vector where the extracted values will be appended.</param>
 /// <param name="word">If true, each expression value is split into two bytes (low and high) before being added to the data vector; if false, the value is added as a single 16-bit value.</param>
-void ExpressionParser::extractExpressionList(std::shared_ptr<ASTNode>& node, std::vector<uint16_t>& data, bool word)
+/// <param name="wordItems">True for the list of a .word directive (a DataBytes node holds its words split lo, hi).</param>
+void ExpressionParser::extractExpressionList(std::shared_ptr<ASTNode>& node, std::vector<uint16_t>& data, bool word, bool wordItems)
 {
+    if (node->type == DataBytes) {
+        // packed by the parser, words already split lo, hi
+        auto& bytes = node->data;
+        if (word || !wordItems) {
+            data.insert(data.end(), bytes.begin(), bytes.end());
+        }
+        else {
+            for (size_t i = 0; i + 1 < bytes.size(); i += 2) {
+                data.push_back(bytes[i] | (bytes[i + 1] << 8));
+            }
+        }
+        return;
+    }
+
     for (auto& child : node->children) {
         if (std::holds_alternative<std::shared_ptr<ASTNode>>(child)) {
             auto& childnode = std::get<std::shared_ptr<ASTNode>>(child);
@@ -56,7 +74,7 @@ void ExpressionParser::extractExpressionList(std::shared_ptr<ASTNode>& node, std
                 }
             }
             else {
-                extractExpressionList(childnode, data, word);
+                extractExpressionList(childnode, data, word, wordItems);
             }
         }
     }
@@ -143,7 +161,6 @@ void ExpressionParser::generate_output_bytes(std::shared_ptr<ASTNode> node)
 
                     auto varTempSymbols = doParser->varSymbols;
 
-                    doParser->rule_processed.clear();
                     doParser->InitPass();  // Reset pass-specific state
                     
                     doParser->varSymbols = varTempSymbols;
@@ -165,7 +182,7 @@ void ExpressionParser::generate_output_bytes(std::shared_ptr<ASTNode> node)
 
                     varTempSymbols = doParser->varSymbols;
                     // doParser->InitPass();  // Reset pass-specific state
-                    doParser->rule_processed.clear();
+                    doParser->reset_rules();
 
                     doParser->varSymbols = varTempSymbols;
 
@@ -310,7 +327,7 @@ void ExpressionParser::generate_output_bytes(std::shared_ptr<ASTNode> node)
         {
             printPC(currentPC);
             if (node->value < 0) {
-                parser->throwError(".ds argument must be non-negative");
+                parser->throwError(DiagCode::Range, ".ds argument must be non-negative");
             }
             for (int i = 0; i < node->value; ++i) {
                 currentPC++;
@@ -327,7 +344,7 @@ void ExpressionParser::generate_output_bytes(std::shared_ptr<ASTNode> node)
         {
             std::vector<uint16_t> bytes;
             auto bytelistNode = std::get<std::shared_ptr<ASTNode>>(node->children[1]);
-            extractExpressionList(bytelistNode, bytes, node->type == WordDirective);
+            extractExpressionList(bytelistNode, bytes, node->type == WordDirective, node->type == WordDirective);
 
             int col = 0;
             bool extra = false;
@@ -585,7 +602,7 @@ void ExpressionParser::generate_assembly(std::shared_ptr<ASTNode> node)
         {
             std::vector<uint16_t> bytes;
             auto bytelistNode = std::get<std::shared_ptr<ASTNode>>(node->children[1]);
-            extractExpressionList(bytelistNode, bytes, false);
+            extractExpressionList(bytelistNode, bytes, false, node->type == WordDirective);
 
             size_t i = 0;
             size_t remaining = bytes.size();
@@ -719,8 +736,8 @@ void ExpressionParser::print_asm()
         std::cout <<
             es.gr({ es.BOLD, es.WHITE_FOREGROUND });
 
-        if (line.first.filename != currentfile) {
-            currentfile = line.first.filename;
+        if (line.first.filename() != currentfile) {
+            currentfile = line.first.filename();
             auto visited = filesprocesseding.contains(currentfile);
             std::string prefix = visited ? "\nResuming " : "\nProcessing ";
 
@@ -744,8 +761,8 @@ void ExpressionParser::print_listfile()
     currentfile = "";
     auto lastline = -1;
     for (auto& line : listLines) {
-        if (line.first.filename != currentfile) {
-            currentfile = line.first.filename;
+        if (line.first.filename() != currentfile) {
+            currentfile = line.first.filename();
             std::cout << "Processsing " << currentfile << "\n";
         }
         if (line.first.line != lastline) {
@@ -758,7 +775,7 @@ void ExpressionParser::print_listfile()
 void ExpressionParser::print_printmap()
 {
     for (const auto& [pos, val] : printMap) {
-        std::cout << pos.filename << " " << pos.line << "   " << val << "\n";
+        std::cout << pos.filename() << " " << pos.line << "   " << val << "\n";
     }
 }
 
@@ -789,8 +806,8 @@ void ExpressionParser::print_outbytes()
 {
     currentfile = "";
     for (auto& line : byteOutput) {
-        if (line.first.filename != currentfile) {
-            currentfile = line.first.filename;
+        if (line.first.filename() != currentfile) {
+            currentfile = line.first.filename();
             std::cout << "Processsing " << currentfile << "\n";
         }
         std::cout << std::setw(3) << line.first.line << ") " << line.second << "\n";
@@ -821,8 +838,8 @@ void ExpressionParser::generate_listing()
         }
         
         // new file
-        if (line.first.filename != currentfile) {
-            currentfile = line.first.filename;
+        if (line.first.filename() != currentfile) {
+            currentfile = line.first.filename();
             auto visited = filesprocesseding.contains(currentfile);
             std::string prefix = visited ? "Resuming " : "Processing ";
 
@@ -924,28 +941,28 @@ void ExpressionParser::generate_file_list(std::shared_ptr<ASTNode> node)
     if (node->type == Line) {
         pos = node->sourcePosition;
 
-        if (pos.filename != currentfile) {
-            currentfile = pos.filename;
-            lines = parser->readfile(currentfile);
+        if (pos.filename() != currentfile) {
+            currentfile = pos.filename();
+            lines = &parser->readfile(currentfile);
         }
 
         // Use the actual source line number from the node position instead of incrementing
-        if (pos.line > 0 && pos.line <= lines.size()) {
+        if (pos.line > 0 && pos.line <= lines->size()) {
             auto lastpos = (listLines.size() > 0)
                 ? listLines[listLines.size() - 1].first
                 : SourcePos();
 
             if (lastpos != pos) {
-                if (pos.filename == lastpos.filename) {
+                if (pos.filename() == lastpos.filename()) {
                     // must use pos.line > lastpos.line because line is unsigned
                     while (pos.line > lastpos.line && pos.line - lastpos.line > 1) {
                         lastpos.line++;
-                        auto insertline = std::pair{ lastpos, lines[lastpos.line - 1].second };
+                        auto insertline = std::pair{ lastpos, std::string(lines->line(lastpos.line - 1)) };
                         listLines.emplace_back(insertline);
                     }
                 }
 
-                auto newline = std::pair{ pos, lines[pos.line - 1].second };
+                auto newline = std::pair{ pos, std::string(lines->line(pos.line - 1)) };
                 listLines.emplace_back(newline);
             }
         }
@@ -969,10 +986,17 @@ ExpressionParser::ExpressionParser(ParserOptions& options) : options(options)
     doParser = std::make_shared<Parser>(Parser(parserDict));
     parser->includeDirectories = options.includeDirectories;
     doParser->includeDirectories = options.includeDirectories;
+    parser->memoize = options.memoize;
+    doParser->memoize = options.memoize;
+    parser->maxErrors = std::max<size_t>(options.maxErrors, 1);
+    tokenizer.useRegex = options.regexTokenizer;
+    tokenizer.jobs = options.jobs;
+    tokenCache.directory = options.cacheDirectory;
+    tokenCache.options = (options.cpu65c02 ? TOKEN_CACHE_65C02 : 0) | (options.allowIllegal ? TOKEN_CACHE_ILLEGAL : 0);
 
     for (auto& file : options.files) {
         fs::path full_path = fs::absolute(fs::path(file)).lexically_normal();
-        lines = parser->readfile(full_path.string());
+        lines = &parser->readfile(full_path.string());
     }
     byteOutput.clear();
     asmOutputLine.clear();
@@ -1012,7 +1036,7 @@ std::shared_ptr<ASTNode> ExpressionParser::Assemble() const
     }
 #endif
 
-    auto tokens = tokenizer.tokenize(lines);
+    TokenStore tokens = tokenCache.tokenize(lines ? *lines : SourceText());
 
     parser->tokens = tokens;
     parser->tokens.clear();
@@ -1022,10 +1046,24 @@ std::shared_ptr<ASTNode> ExpressionParser::Assemble() const
             std::cout << es.gr(es.BRIGHT_GREEN_FOREGROUND) << "Pass " << es.gr(es.BRIGHT_YELLOW_FOREGROUND) << pass << "\n";
 
         needPass = false;
-        parser->tokens.assign(tokens.begin(), tokens.end());
+        parser->tokens = tokens;
         ast = parser->Pass();
         ++pass;
 
+        // a pass with errors is not repeated, later passes find them again
+        if (!parser->diagnostics.empty()) {
+            for (auto& diagnostic : parser->diagnostics) {
+                auto text = parser->format_diagnostic(diagnostic);
+                if (text.back() != '\n')
+                    text += '\n';
+                std::cerr <<
+                    es.gr(es.BRIGHT_RED_FOREGROUND) <<
+                    "Error (" << diagCodeName(diagnostic.code) << "): " << text <<
+                    es.gr(es.RESET_ALL);
+            }
+            throw std::runtime_error(std::to_string(parser->diagnostics.size()) + " error(s) in pass " + std::to_string(parser->pass));
+        }
+
 #if __DEBUG_TOKENS__
         if (options.verbose)
             parser->printTokens();
@@ -1053,6 +1091,32 @@ std::shared_ptr<ASTNode> ExpressionParser::Assemble() const
         needPass |= unresolved_locals.size() > 0 || parser->localSymbols.changes != 0;
     } while (pass < max_passes && needPass);
 
+    if (options.verbose && parser->includeCacheHits + parser->includeCacheMisses > 0) {
+        std::cout << es.gr(es.BRIGHT_GREEN_FOREGROUND) << "Include cache " <<
+            es.gr(es.BRIGHT_YELLOW_FOREGROUND) << parser->includeCacheHits <<
+            es.gr(es.BRIGHT_CYAN_FOREGROUND) << " hits " <<
+            es.gr(es.BRIGHT_YELLOW_FOREGROUND) << parser->includeCacheMisses <<
+            es.gr(es.BRIGHT_CYAN_FOREGROUND) << " misses" << es.gr(es.RESET_ALL) << "\n";
+    }
+    if (options.verbose && !tokenCache.directory.empty()) {
+        std::cout << es.gr(es.BRIGHT_GREEN_FOREGROUND) << "Token cache " <<
+            es.gr(es.BRIGHT_YELLOW_FOREGROUND) << tokenCache.hits <<
+            es.gr(es.BRIGHT_CYAN_FOREGROUND) << " hits " <<
+            es.gr(es.BRIGHT_YELLOW_FOREGROUND) << tokenCache.misses <<
+            es.gr(es.BRIGHT_CYAN_FOREGROUND) << " misses" << es.gr(es.RESET_ALL) << "\n";
+    }
+    if (options.verbose && options.memoize) {
+        std::cout << es.gr(es.BRIGHT_GREEN_FOREGROUND) << "Parse memo " <<
+            es.gr(es.BRIGHT_YELLOW_FOREGROUND) << parser->memoHits + doParser->memoHits <<
+            es.gr(es.BRIGHT_CYAN_FOREGROUND) << " hits " <<
+            es.gr(es.BRIGHT_YELLOW_FOREGROUND) << parser->memoMisses + doParser->memoMisses <<
+            es.gr(es.BRIGHT_CYAN_FOREGROUND) << " misses " <<
+            es.gr(es.BRIGHT_YELLOW_FOREGROUND) << parser->memoTokensSaved + doParser->memoTokensSaved <<
+            es.gr(es.BRIGHT_CYAN_FOREGROUND) << " tokens saved " <<
+            es.gr(es.BRIGHT_YELLOW_FOREGROUND) << parser->memoInvalidations + doParser->memoInvalidations <<
+            es.gr(es.BRIGHT_CYAN_FOREGROUND) << " invalidations" << es.gr(es.RESET_ALL) << "\n";
+    }
+
     if (!unresolved.empty()) {
         std::string err = "Unresolved global symbols:";
         for (auto& sym : unresolved) { 
@@ -1086,8 +1150,8 @@ std::shared_ptr<ASTNode> ExpressionParser::parse() const
     }
 #endif
     if (parser->current_pos < parser->tokens.size()) {
-        const Token& tok = parser->tokens[parser->current_pos];
-        parser->throwError("Unexpected token: '" + tok.value + "'");
+        const Token tok = parser->tokens[parser->current_pos];
+        parser->throwError("Unexpected token: '" + std::string(tok.value) + "'");
     }
     return ast;
 }
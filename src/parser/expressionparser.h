@@ -54,6 +54,21 @@ struct ParserOptions {
 
     // Show all symbols when printing symbol tables
     bool showAllSymbols = false;
+
+    // Tokenize with the regex patterns instead of the scanner
+    bool regexTokenizer = false;
+
+    // Threads used to tokenize source (1 = single threaded)
+    unsigned jobs = 1;
+
+    // Directory of the on-disk token cache (empty = no cache)
+    std::string cacheDirectory = "";
+
+    // Memoize pure rule parses while backtracking (-memo turns it on)
+    bool memoize = false;
+
+    // Errors reported before assembly stops (1 = stop at the first error)
+    size_t maxErrors = 1;
 };
 
 /*
@@ -85,8 +100,8 @@ public:
     // Top-level entry that generates output from an AST root node.
     void generate_output(std::shared_ptr<ASTNode> node);
 
-    // Raw lines collected from input (source position, text)
-    std::vector<std::pair<SourcePos, std::string>> lines;
+    // Lines of the current input file (owned by parser->fileCache)
+    const SourceText* lines = nullptr;
 
     // Final assembled bytes produced (skips bytes created while in macros)
     std::vector<uint8_t> output_bytes;
@@ -143,7 +158,8 @@ private:
 
     // Extracts a list of numeric expressions (bytes/words) from an AST node
     // If 'word' is true, pushes 16-bit values; otherwise pushes 8-bit values.
-    void extractExpressionList(std::shared_ptr<ASTNode>& node, std::vector<uint16_t>& data, bool word = false);
+    // 'wordItems' tells a DataBytes node of a .word directive from one of a .byte.
+    void extractExpressionList(std::shared_ptr<ASTNode>& node, std::vector<uint16_t>& data, bool word = false, bool wordItems = false);
 
     // Formatting helpers used while building the byte/assembly listing.
     // These functions append formatted content to byteOutputLine.
@@ -153,17 +169,12 @@ private:
         if (inMacrodefinition)
             return;
 
-        std::stringstream ss;
-
-        ss
-            << "$"
-            << std::hex << std::uppercase << std::setw(4) << std::setfill('0')
-            << (int)pc << ":"
-            << std::dec << std::setw(0) << std::nouppercase << std::setfill(' ');
-
-        std::string str;
-        ss >> str;
-        byteOutputLine += str;
+        // "$XXXX:" (formatted by hand, this runs for every listing line)
+        const char text[] = {
+            '$', hexDigits[(pc >> 12) & 0xF], hexDigits[(pc >> 8) & 0xF],
+            hexDigits[(pc >> 4) & 0xF], hexDigits[pc & 0xF], ':'
+        };
+        byteOutputLine.append(text, sizeof(text));
     }
 
     // Append a single byte in formatted hex to the current byteOutputLine.
@@ -172,15 +183,9 @@ private:
         if (inMacrodefinition)
             return;
 
-        std::stringstream ss;
-        ss
-            << "$"
-            << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << static_cast<int>(value)
-            << std::dec << std::nouppercase << std::setw(0) << std::setfill(' ');
-
-        std::string str;
-        ss >> str;
-        byteOutputLine += paddLeft(str, 4);
+        // " $XX", right aligned in 4 columns
+        const char text[] = { ' ', '$', hexDigits[value >> 4], hexDigits[value & 0xF] };
+        byteOutputLine.append(text, sizeof(text));
     }
 
     // Emit a byte to the assembled output and validate PC sequencing.
@@ -218,6 +223,9 @@ private:
         printbyte(hi);
     }
 
+    // Upper case hex digits used by printPC / printbyte
+    static constexpr char hexDigits[] = "0123456789ABCDEF";
+
     // Working strings used while composing output lines
     std::string byteOutputLine;
     std::string asmOutputLine;
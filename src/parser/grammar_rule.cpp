@@ -1,3 +1,164 @@
 // written by Paul Baxter
 // grammar_rule.cpp
 #include "grammar_rule.h"
+
+//=============================================================================
+// FIRST sets
+//=============================================================================
+
+/// <summary>
+/// FIRST set of one production given the current rule table.
+/// A reference to a rule missing from the grammar admits any token.
+/// </summary>
+static FirstSet productionFirst(const std::vector<int64_t>& production, const std::vector<RuleFirst>& table)
+{
+    FirstSet result;
+
+    // production[0] is the rule type itself
+    for (size_t i = 1; i < production.size(); ++i) {
+        int64_t element = production[i];
+        if (element >= 0) {
+            if (element < TOKEN_TYPE::LAST)
+                result.tokens.set(static_cast<size_t>(element));
+            return result;
+        }
+
+        int64_t rule = -element;
+        if (rule < Factor || rule > Prog || !grammar_rules.contains(rule)) {
+            result.tokens.set();
+            return result;
+        }
+        auto& sub = table[rule - Factor].first;
+        result.tokens |= sub.tokens;
+        if (!sub.nullable)
+            return result;
+    }
+    result.nullable = true;
+    return result;
+}
+
+/// <summary>
+/// Compute the FIRST sets of every rule by iterating to a fixed point
+/// (the grammar is recursive, e.g. Factor -> ( Expr ) ).
+/// </summary>
+static std::vector<RuleFirst> computeFirstSets()
+{
+    std::vector<RuleFirst> table(Prog - Factor + 1);
+    for (auto& [rule, handler] : grammar_rules) {
+        if (rule >= Factor && rule <= Prog)
+            table[rule - Factor].productions.resize(handler.productions.size());
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& [rule, handler] : grammar_rules) {
+            if (rule < Factor || rule > Prog)
+                continue;
+            auto& entry = table[rule - Factor];
+            for (size_t alt = 0; alt < handler.productions.size(); ++alt) {
+                auto first = productionFirst(handler.productions[alt], table);
+                if (first == entry.productions[alt])
+                    continue;
+                entry.productions[alt] = first;
+                entry.first.tokens |= first.tokens;
+                entry.first.nullable |= first.nullable;
+                changed = true;
+            }
+        }
+    }
+    return table;
+}
+
+const RuleFirst* ruleFirst(int64_t rule)
+{
+    static const std::vector<RuleFirst> table = computeFirstSets();
+    if (rule < Factor || rule > Prog || !grammar_rules.contains(rule))
+        return nullptr;
+    return &table[rule - Factor];
+}
+
+/// <summary>
+/// Print every pair of alternatives of a rule whose FIRST sets overlap,
+/// with the token types they share.
+/// </summary>
+/// <param name="out">Report stream.</param>
+/// <param name="names">Token and rule names (parserDict).</param>
+void reportGrammarConflicts(std::ostream& out, const std::map<int64_t, std::string>& names)
+{
+    auto name = [&names](int64_t id)
+    {
+        auto it = names.find(id);
+        return it != names.end() ? it->second : std::to_string(id);
+    };
+
+    for (int64_t rule = Factor; rule <= Prog; ++rule) {
+        auto first = ruleFirst(rule);
+        if (!first)
+            continue;
+        auto& alts = first->productions;
+        for (size_t i = 0; i < alts.size(); ++i) {
+            for (size_t j = i + 1; j < alts.size(); ++j) {
+                auto shared = alts[i].tokens & alts[j].tokens;
+                bool bothNullable = alts[i].nullable && alts[j].nullable;
+                if (shared.none() && !bothNullable)
+                    continue;
+
+                out << name(rule) << ": alternatives " << i << " and " << j << " conflict on";
+                for (size_t t = 0; t < shared.size(); ++t) {
+                    if (shared.test(t))
+                        out << " " << name(static_cast<int64_t>(t));
+                }
+                if (bothNullable)
+                    out << " <empty>";
+                out << "\n";
+            }
+        }
+    }
+}
+
+//=============================================================================
+// Compiled grammar
+//=============================================================================
+
+/// <summary>
+/// Flatten grammar_rules into arrays indexed by rule id, with the FIRST set
+/// of every production and the memo slot of every pure rule.
+/// </summary>
+static CompiledGrammar compileGrammar()
+{
+    CompiledGrammar g;
+    for (int64_t id = Factor; id <= Prog; ++id) {
+        auto it = grammar_rules.find(id);
+        if (it == grammar_rules.end())
+            continue;
+
+        const RuleHandler& handler = it->second;
+        const RuleFirst* first = ruleFirst(id);
+        auto& rule = g.rules[id - Factor];
+        rule.action = handler.action;
+        rule.pure = handler.pure;
+        rule.memoSlot = handler.pure ? g.memoSlots++ : -1;
+        rule.firstProduction = static_cast<uint32_t>(g.productions.size());
+        rule.productionCount = static_cast<uint32_t>(handler.productions.size());
+
+        for (size_t alt = 0; alt < handler.productions.size(); ++alt) {
+            auto& production = handler.productions[alt];
+            CompiledProduction compiled;
+            compiled.first = static_cast<uint32_t>(g.elements.size());
+            compiled.size = production.empty() ? 0 : static_cast<uint32_t>(production.size() - 1);
+            compiled.start = first->productions[alt];
+            for (size_t i = 1; i < production.size(); ++i) {
+                g.elements.push_back(static_cast<int32_t>(production[i]));
+            }
+            g.productions.push_back(compiled);
+        }
+    }
+    return g;
+}
+
+const CompiledGrammar& compiledGrammar()
+{
+    static const CompiledGrammar grammar = compileGrammar();
+    return grammar;
+}
@@ -1,8 +1,12 @@
 // written by Paul Baxter
 // grammar_rule.h
 #pragma once
+#include <array>
+#include <bitset>
 #include <functional>
+#include <map>
 #include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 #include <cinttypes>
@@ -10,13 +14,91 @@
 #include "parser.h"
 #include "common_types.h"
 #include "expr_rules.h"
+#include "token.h"
 
 // Forward declaration
 class Parser;
 
+// Semantic action of a rule. Actions are capture-less lambdas, so they are
+// held as plain function pointers (no std::function type erasure).
+using RuleAction = std::shared_ptr<ASTNode>(*)(Parser&, const std::vector<RuleArg>&, int);
+
 struct RuleHandler {
     std::vector<std::vector<int64_t>> productions;
-    std::function<std::shared_ptr<ASTNode>(Parser&, const std::vector<RuleArg>&, int)> action;
+    RuleAction action;
+
+    // True if the action only builds its node from the arguments and the
+    // current parser state (no symbol, PC, scope or token stream changes).
+    // parse_rule memoizes pure rules by (token position, rule).
+    bool pure = false;
 };
 
+// Value for RuleHandler::pure in the grammar table.
+constexpr bool PURE_RULE = true;
+
 extern const std::unordered_map<int64_t, RuleHandler> grammar_rules;
+
+// Token types a production or rule can start with. A nullable production can
+// match without consuming a token.
+struct FirstSet {
+    std::bitset<TOKEN_TYPE::LAST> tokens;
+    bool nullable = false;
+
+    // True if a parse at a token of this type can match.
+    // LAST stands for the end of the token stream.
+    bool admits(TOKEN_TYPE type) const { return nullable || (type < TOKEN_TYPE::LAST && tokens.test(type)); }
+
+    bool operator==(const FirstSet& other) const = default;
+};
+
+struct RuleFirst {
+    FirstSet first;                     // union of the productions
+    std::vector<FirstSet> productions;  // same order as RuleHandler::productions
+};
+
+// FIRST set of a rule in grammar_rules, computed once on first use.
+// nullptr if the rule does not exist.
+const RuleFirst* ruleFirst(int64_t rule);
+
+// Print the alternatives of each rule whose FIRST sets overlap (the parser
+// backtracks between them).
+void reportGrammarConflicts(std::ostream& out, const std::map<int64_t, std::string>& names);
+
+// Rule ids are contiguous from Factor to Prog.
+constexpr size_t RULE_COUNT = Prog - Factor + 1;
+
+// One production of a compiled rule.
+struct CompiledProduction {
+    uint32_t first;     // index of its first element in CompiledGrammar::elements
+    uint32_t size;      // number of elements (the leading rule id is dropped)
+    FirstSet start;     // FIRST set of the production
+};
+
+// One rule of the compiled grammar.
+struct CompiledRule {
+    RuleAction action = nullptr;    // nullptr if the rule id has no rule
+    uint32_t firstProduction = 0;   // index in CompiledGrammar::productions
+    uint32_t productionCount = 0;
+    bool pure = false;
+    int memoSlot = -1;              // slot in a memo row, -1 if not memoized
+};
+
+// grammar_rules flattened into arrays indexed by rule id - Factor, so
+// parse_rule reaches a rule, its productions and their elements by indexing.
+// Elements are terminals (token types) or negated rule ids as in grammar_rules.
+struct CompiledGrammar {
+    std::array<CompiledRule, RULE_COUNT> rules;
+    std::vector<CompiledProduction> productions;
+    std::vector<int32_t> elements;
+    int memoSlots = 0;              // number of memoized (pure) rules
+
+    const CompiledRule* rule(int64_t id) const
+    {
+        if (id < Factor || id > Prog || rules[id - Factor].action == nullptr)
+            return nullptr;
+        return &rules[id - Factor];
+    }
+};
+
+// The compiled grammar, built from grammar_rules on first use.
+const CompiledGrammar& compiledGrammar();
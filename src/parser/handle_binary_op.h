@@ -4,6 +4,7 @@
 #include <set>
 
 #include "grammar_rule.h"
+#include "node_pool.h"
 #include "token.h"
 
 /**
@@ -22,7 +23,7 @@
  * Important: this template expects to be used inside the parser implementation
  * where the following names are available in scope (free variables):
  *  - `current_pos` (size_t)  current index in the `tokens` vector
- *  - `tokens` (std::vector<Token>)  token input stream
+ *  - `tokens` (TokenStore)  token input stream
  *  - `get_token_info(size_t)` or similar diagnostic helper used for errors
  *
  * Template parameters:
@@ -48,11 +49,11 @@
  *
  *  - allowed_ops
  *      Set of `TOKEN_TYPE` values considered valid binary operators for this
- *      production. Matching is performed against `tokens[current_pos].type`.
+ *      production. Matching is performed against `tokens.type(current_pos)`.
  *
  *  - rule_type
  *      Numeric tag (from your RULE_TYPE / AST conventions) used when creating
- *      the binary AST node: `auto node = std::make_shared<ASTNode>(rule_type);`
+ *      the binary AST node: `auto node = makeNode(rule_type);`
  *
  *  - parse_right_operand
  *      See RuleFunc above  callable that parses the right-hand side and
@@ -90,18 +91,18 @@ std::shared_ptr<ASTNode> handle_binary_op(
     CalcFunc calculate_value)
 {
     while (current_pos < tokens.size() &&
-        allowed_ops.contains(tokens[current_pos].type)) {
+        allowed_ops.contains(tokens.type(current_pos))) {
         Token op = tokens[current_pos++];
         auto right = parse_right_operand();
         if (!right) {
             throw std::runtime_error(
                 "Syntax error: expected " + expected_operand_name +
-                " after operator '" + op.value + "' " +
+                " after operator '" + std::string(op.value) + "' " +
                 get_token_info(current_pos)
             );
         }
 
-        auto node = std::make_shared<ASTNode>(rule_type);
+        auto node = makeNode(rule_type);
         node->add_child(left);
         node->add_child(op);
         node->add_child(right);
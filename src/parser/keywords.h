@@ -0,0 +1,166 @@
+// written by Paul Baxter
+// keywords.h
+//
+// Compile time perfect hash over the keyword spellings the scanner recognizes:
+// every mnemonic in TOKEN_MNEMONICS plus the registers and directives in
+// TOKEN_KEYWORDS (token.h). Because the table is generated from the same lists
+// that define TOKEN_TYPE, adding an opcode to token.h is all that is needed for
+// the scanner to recognize it.
+//
+// The table uses hash and displace: one FNV-1a pass over the case folded word
+// gives both the bucket and the slot hash; a per bucket displacement computed at
+// compile time makes the slot collision free. A lookup is one hash and one
+// string compare regardless of the number of keywords.
+#pragma once
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+#include "token.h"
+
+struct KeywordEntry {
+    std::string_view word;      // upper case spelling
+    TOKEN_TYPE type;
+};
+
+inline constexpr KeywordEntry keywordEntries[] = {
+#define KEYWORD_MNEMONIC(name) { #name, name },
+#define KEYWORD_SPELLING(type, spelling) { spelling, type },
+    TOKEN_MNEMONICS(KEYWORD_MNEMONIC)
+    TOKEN_KEYWORDS(KEYWORD_SPELLING)
+#undef KEYWORD_MNEMONIC
+#undef KEYWORD_SPELLING
+};
+
+inline constexpr size_t keywordCount = std::size(keywordEntries);
+inline constexpr size_t keywordBuckets = 64;
+inline constexpr size_t keywordSlots = 512;     // power of two
+
+static_assert(keywordCount < keywordSlots / 2, "grow keywordSlots");
+
+/// <summary>
+/// Upper case an ASCII letter; other characters are returned unchanged.
+/// </summary>
+constexpr char keywordFold(char c)
+{
+    return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+/// <summary>
+/// FNV-1a over the case folded word.
+/// </summary>
+constexpr uint64_t keywordHash(std::string_view word)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (auto c : word) {
+        h ^= static_cast<unsigned char>(keywordFold(c));
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/// <summary>
+/// Slot for a hash under displacement d.
+/// </summary>
+constexpr size_t keywordSlot(uint64_t h, uint32_t d)
+{
+    return static_cast<size_t>((h >> 16) + d * ((h >> 40) | 1)) & (keywordSlots - 1);
+}
+
+struct KeywordTable {
+    std::array<uint32_t, keywordBuckets> displacement{};
+    std::array<int16_t, keywordSlots> entry{};      // index into keywordEntries, -1 when empty
+    size_t maxLength = 0;
+};
+
+/// <summary>
+/// Build the displacement and slot tables. Buckets are placed largest first.
+/// Fails to compile if a spelling is listed twice (no displacement can separate it).
+/// </summary>
+constexpr KeywordTable buildKeywordTable()
+{
+    KeywordTable table;
+    table.entry.fill(-1);
+
+    std::array<uint64_t, keywordCount> hashes{};
+    std::array<size_t, keywordBuckets> sizes{};
+    for (size_t i = 0; i < keywordCount; ++i) {
+        hashes[i] = keywordHash(keywordEntries[i].word);
+        ++sizes[hashes[i] % keywordBuckets];
+        if (keywordEntries[i].word.size() > table.maxLength)
+            table.maxLength = keywordEntries[i].word.size();
+    }
+
+    std::array<bool, keywordBuckets> placed{};
+    for (size_t n = 0; n < keywordBuckets; ++n) {
+        size_t bucket = 0;
+        for (size_t b = 0; b < keywordBuckets; ++b) {
+            if (!placed[b] && (placed[bucket] || sizes[b] > sizes[bucket]))
+                bucket = b;
+        }
+        placed[bucket] = true;
+
+        std::array<size_t, keywordCount> members{};
+        size_t count = 0;
+        for (size_t i = 0; i < keywordCount; ++i) {
+            if (hashes[i] % keywordBuckets == bucket)
+                members[count++] = i;
+        }
+        if (count == 0)
+            continue;
+
+        bool found = false;
+        for (uint32_t d = 0; d < 100000 && !found; ++d) {
+            std::array<size_t, keywordCount> slots{};
+            found = true;
+            for (size_t k = 0; k < count && found; ++k) {
+                slots[k] = keywordSlot(hashes[members[k]], d);
+                if (table.entry[slots[k]] >= 0)
+                    found = false;
+                for (size_t j = 0; j < k && found; ++j) {
+                    if (slots[j] == slots[k])
+                        found = false;
+                }
+            }
+            if (found) {
+                table.displacement[bucket] = d;
+                for (size_t k = 0; k < count; ++k)
+                    table.entry[slots[k]] = static_cast<int16_t>(members[k]);
+            }
+        }
+        if (!found)
+            throw std::logic_error("keyword table: duplicate keyword spelling");
+    }
+    return table;
+}
+
+inline constexpr KeywordTable keywordTable = buildKeywordTable();
+
+/// <summary>
+/// Classify a word (any case) as a keyword.
+/// </summary>
+/// <param name="word">Identifier or directive text, directives including the leading '.'.</param>
+/// <returns>The keyword token type or INVALID.</returns>
+constexpr TOKEN_TYPE lookupKeyword(std::string_view word)
+{
+    if (word.empty() || word.size() > keywordTable.maxLength)
+        return INVALID;
+
+    auto h = keywordHash(word);
+    auto index = keywordTable.entry[keywordSlot(h, keywordTable.displacement[h % keywordBuckets])];
+    if (index < 0)
+        return INVALID;
+
+    auto& entry = keywordEntries[index];
+    if (entry.word.size() != word.size())
+        return INVALID;
+    for (size_t i = 0; i < word.size(); ++i) {
+        if (keywordFold(word[i]) != entry.word[i])
+            return INVALID;
+    }
+    return entry.type;
+}
+
+static_assert(lookupKeyword("lda") == LDA && lookupKeyword(".Byte") == BYTE && lookupKeyword("ldax") == INVALID);
@@ -0,0 +1,42 @@
+// written by Paul Baxter
+// node_pool.cpp
+#include <algorithm>
+
+#include "node_pool.h"
+
+// Bytes per chunk of slots
+static constexpr size_t CHUNK_BYTES = 64 * 1024;
+
+/// <summary>
+/// A pool of slots of slotSize bytes. A free slot holds the free list link
+/// and every slot is aligned for any fundamental type, like new[].
+/// </summary>
+NodePool::NodePool(size_t slotSize)
+{
+    constexpr size_t align = alignof(std::max_align_t);
+    this->slotSize = (std::max(slotSize, sizeof(FreeSlot)) + align - 1) / align * align;
+}
+
+/// <summary>
+/// Add a chunk of slots to the free list. The chunk is kept until the end of
+/// the run.
+/// </summary>
+void NodePool::grow()
+{
+    const size_t count = std::max<size_t>(CHUNK_BYTES / slotSize, 1);
+    chunks.emplace_back(new std::byte[count * slotSize]);
+    std::byte* base = chunks.back().get();
+
+    // thread the slots in address order so a fresh chunk is filled front to back
+    for (size_t i = count; i-- > 0;) {
+        auto slot = reinterpret_cast<FreeSlot*>(base + i * slotSize);
+        slot->next = freeList;
+        freeList = slot;
+    }
+}
+
+NodePool& nodePool()
+{
+    static NodePool& pool = *new NodePool(NODE_SLOT_SIZE);
+    return pool;
+}
@@ -0,0 +1,110 @@
+// written by Paul Baxter
+// node_pool.h
+//
+// Pooled allocation of AST nodes.
+//
+//  - makeNode(...) is std::make_shared<ASTNode>(...) with the node and its
+//    reference count placed in a slot of the NodePool instead of a heap block.
+//  - The pool carves its slots from large chunks and keeps released slots on
+//    a free list. A pass releases the tree of the pass before it, so later
+//    passes (and .do loop iterations) build their trees in reused slots.
+//  - Only the node block itself is pooled. A node's children vector (and the
+//    data vector of a DataBytes node) still allocates from the heap, so a
+//    pass still makes one or more allocations per interior node; the pool
+//    saves the one allocation per node that make_shared made. Reference
+//    counts are still the atomic ones of std::shared_ptr.
+//  - Chunks are kept for the whole run. Nodes are created and released on
+//    the parsing thread only (the pool is not synchronized).
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "ASTNode.h"
+
+class NodePool {
+public:
+    explicit NodePool(size_t slotSize);
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    void* allocate()
+    {
+        if (!freeList)
+            grow();
+        FreeSlot* slot = freeList;
+        freeList = slot->next;
+        ++used;
+        return slot;
+    }
+
+    void deallocate(void* p)
+    {
+        auto slot = static_cast<FreeSlot*>(p);
+        slot->next = freeList;
+        freeList = slot;
+        --used;
+    }
+
+    size_t slotsUsed() const { return used; }
+    size_t chunkCount() const { return chunks.size(); }
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    void grow();
+
+    size_t slotSize;
+    FreeSlot* freeList = nullptr;
+    size_t used = 0;
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+};
+
+// A slot holds an ASTNode and the shared_ptr control block around it.
+constexpr size_t NODE_SLOT_SIZE = sizeof(ASTNode) + 4 * sizeof(void*);
+
+// The pool makeNode allocates from. Never destroyed, so nodes held by
+// static objects may be released at exit.
+NodePool& nodePool();
+
+// Allocator handing out single objects from nodePool() (std::allocate_shared
+// rebinds it to its control block type).
+template <class T>
+struct NodeAllocator {
+    using value_type = T;
+
+    NodeAllocator() = default;
+    template <class U>
+    NodeAllocator(const NodeAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        static_assert(sizeof(T) <= NODE_SLOT_SIZE && alignof(T) <= alignof(std::max_align_t));
+        if (n != 1)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(nodePool().allocate());
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (n != 1) {
+            ::operator delete(p);
+            return;
+        }
+        nodePool().deallocate(p);
+    }
+
+    template <class U>
+    bool operator==(const NodeAllocator<U>&) const { return true; }
+};
+
+// std::make_shared<ASTNode>(args...) with the node in a pool slot
+template <class... Args>
+std::shared_ptr<ASTNode> makeNode(Args&&... args)
+{
+    return std::allocate_shared<ASTNode>(NodeAllocator<ASTNode>(), std::forward<Args>(args)...);
+}
@@ -1,5 +1,6 @@
 // written by Paul Baxter
 #include  <map>
+#include <vector>
 
 #include "expr_rules.h"
 #include "opcodedict.h"
@@ -1731,3 +1732,30 @@ std::map<TOKEN_TYPE, OpCodeInfo> opcodeDict = {
         } 
     }
 };
+
+/// <summary>
+/// Dense view of opcodeDict indexed by instruction token.
+/// </summary>
+const OpCodeModes* opcodeModes(TOKEN_TYPE op)
+{
+    static const std::vector<OpCodeModes> table = []
+    {
+        std::vector<OpCodeModes> modes(TOKEN_TYPE::LAST);
+        for (auto& entry : modes) {
+            entry.opcodes.fill(-1);
+        }
+        for (auto& [tok, info] : opcodeDict) {
+            auto& entry = modes[tok];
+            entry.info = &info;
+            for (auto& [mode, opcode] : info.mode_to_opcode) {
+                if (mode >= Op_Implied && mode <= Op_ZeroPageRelative)
+                    entry.opcodes[mode - Op_Implied] = opcode.first;
+            }
+        }
+        return modes;
+    }();
+
+    if (op < 0 || op >= TOKEN_TYPE::LAST || table[op].info == nullptr)
+        return nullptr;
+    return &table[op];
+}
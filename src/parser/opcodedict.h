@@ -1,5 +1,6 @@
 // written by Paul Baxter
 #pragma once
+#include <array>
 #include <cstdint>
 #include <map>
 #include <string>
@@ -31,4 +32,24 @@ struct OpCodeInfo {
     }
 };
 
-extern std::map<TOKEN_TYPE, OpCodeInfo> opcodeDict;
\ No newline at end of file
+extern std::map<TOKEN_TYPE, OpCodeInfo> opcodeDict;
+
+// Addressing modes Op_Implied .. Op_ZeroPageRelative
+constexpr int OPCODE_MODES = Op_ZeroPageRelative - Op_Implied + 1;
+
+// Opcode byte of an instruction for each addressing mode, so resolving a mode
+// is one array index instead of a map search.
+struct OpCodeModes {
+    const OpCodeInfo* info = nullptr;
+    std::array<int16_t, OPCODE_MODES> opcodes;     // -1 = mode not supported
+
+    bool supports(int64_t mode) const
+    {
+        return mode >= Op_Implied && mode <= Op_ZeroPageRelative && opcodes[mode - Op_Implied] >= 0;
+    }
+    uint8_t opcode(int64_t mode) const { return static_cast<uint8_t>(opcodes[mode - Op_Implied]); }
+};
+
+// Modes of an instruction token (built from opcodeDict on first use).
+// nullptr if the token is not an instruction.
+const OpCodeModes* opcodeModes(TOKEN_TYPE op);
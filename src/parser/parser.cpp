@@ -6,6 +6,8 @@
 // macro expansion, file inclusion, and multi-pass assembly support.
 //
 
+#include <algorithm>
+#include <array>
 #include <iomanip>
 #include <stack>
 #include <fstream>
@@ -20,7 +22,12 @@
 #include "ANSI_esc.h"
 #include "parser.h"
 #include "grammar_rule.h"
+#include "source_buffer.h"
+#include "source_text.h"
 #include "token.h"
+#include "token_cache.h"
+#include "tokenizer.h"
+#include "utils.h"
 #include <expressionparser.h>
 
 // Disable warning C4715: 'not all control paths return a value'
@@ -32,20 +39,6 @@
 //=============================================================================
 
 
-/// <summary>
-/// Tracks which grammar rules have been processed at specific token positions.
-/// Key: pair of (token position, rule type)
-/// Value: count of how many times this rule was processed at this position
-/// This prevents infinite recursion and enables proper handling of repeated rules.
-/// </summary>
-std::map<std::pair<size_t, int64_t>, int> Parser::rule_processed;
-
-/// <summary>
-/// Stack for saving and restoring parser state during speculative parsing.
-/// Enables backtracking when a grammar rule match fails.
-/// </summary>
-std::stack<ParseState> parseStack;
-
 //=============================================================================
 // Parse State Management
 //=============================================================================
@@ -56,7 +49,7 @@ std::stack<ParseState> parseStack;
 /// allowing the parser to backtrack if necessary.
 /// </summary>
 /// <param name="state">The current parse state to preserve.</param>
-void Parser::pushParseState(ParseState& state)
+void Parser::pushParseState(const ParseState& state)
 {
     parseStack.push(state);
 }
@@ -73,6 +66,48 @@ ParseState Parser::popParseState()
     return state;
 }
 
+/// <summary>
+/// Restores a state taken by getCurrentState, undoing the token edits
+/// journaled since (newest first).
+/// </summary>
+/// <param name="state">The state to return to.</param>
+void Parser::setCurrentState(const ParseState& state)
+{
+    while (tokenEdits.size() > state.tokenEdits) {
+        auto& edit = tokenEdits.back();
+        tokens.erase(edit.at, edit.at + edit.inserted);
+        tokens.insert(edit.at, edit.removed);
+        tokenEdits.pop_back();
+    }
+
+    filename = state.filename;
+    current_pos = state.current_pos;
+    sourcePos = state.current_source;
+    PC = state.PC;
+    bytesInLine = state.bytesInLine;
+    invalidateMemo();
+}
+
+/// <summary>
+/// Journals the tokens [first, last) about to be erased.
+/// </summary>
+void Parser::recordErase(size_t first, size_t last)
+{
+    if (journaling) {
+        tokenEdits.push_back({ first, 0, tokens.range(first, last) });
+    }
+}
+
+/// <summary>
+/// Journals count tokens just inserted at `at`.
+/// </summary>
+void Parser::recordInsert(size_t at, size_t count)
+{
+    if (journaling && count > 0) {
+        tokenEdits.push_back({ at, count, TokenStore() });
+    }
+}
+
 //=============================================================================
 // Main Parse Entry Point
 //=============================================================================
@@ -93,32 +128,463 @@ std::shared_ptr<ASTNode> Parser::parse()
 
 #else
     // Create a root node for the program
-    auto root = std::make_shared<ASTNode>(RULE_TYPE::Prog);
+    auto root = makeNode(RULE_TYPE::Prog);
 
-    auto linelist = std::make_shared<ASTNode>(RULE_TYPE::LineList);
+    auto linelist = makeNode(RULE_TYPE::LineList);
     root->add_child(linelist);
 
     // Instead of: return parse_rule(RULE_TYPE::Prog);
     // Use a loop to consume statements until the end of the token stream
     while (current_pos < tokens.size()) {
+        std::shared_ptr<ASTNode> line;
+        if (maxErrors > 1) {
+            // Collecting errors: an error skips the rest of its line
+            const size_t start = current_pos;
+            try {
+                line = parse_line(linelist->children.size());
+            }
+            catch (const std::exception& error) {
+                if (!recover(error, start))
+                    break;
+                continue;
+            }
+        }
+        else {
+            line = parse_line(linelist->children.size());
+        }
+
+        if (!line)
+            break;
+        linelist->add_child(line);
+    }
+    return root;
+#endif
+}
+
+/// <summary>
+/// Replays the line at current_pos if nothing it read changed since the last
+/// pass, otherwise parses it (data lines of literals skip the grammar).
+/// </summary>
+/// <param name="ordinal">Index of the line in the LineList.</param>
+/// <returns>The Line node, or nullptr at the end of the tokens.</returns>
+std::shared_ptr<ASTNode> Parser::parse_line(size_t ordinal)
+{
+    DropConditionalCloser();
+    auto line = replay_line(ordinal);
+    if (line)
+        return line;
+
+    const size_t start = current_pos;
+    const int32_t startPC = PC;
+    lineInputs.clear();
+    lineInputs.tracing = true;
+    line = parse_data_line();
+    if (!line)
+        line = parse_rule(RULE_TYPE::Line);
+    lineInputs.tracing = false;
+
+    if (line) {
+        record_line(ordinal, start, startPC, line);
+    }
+    else if (current_pos < tokens.size()) {
+        // If we are not at the end, it's a syntax error
+        throwError(DiagCode::Syntax, "Unexpected token or syntax error");
+    }
+    return line;
+}
+
+/// <summary>
+/// Records the error raised by the line starting at start and resumes after
+/// the EOL ending it. The bytes and inputs of the failed line are dropped.
+/// </summary>
+/// <param name="error">A ParseError, or any exception thrown while parsing.</param>
+/// <param name="start">Token index of the line.</param>
+/// <returns>False when maxErrors errors were recorded or no line follows.</returns>
+bool Parser::recover(const std::exception& error, size_t start)
+{
+    if (auto parseError = dynamic_cast<const ParseError*>(&error)) {
+        diagnostics.push_back(parseError->diagnostic);
+    }
+    else {
+        Token tok = current_pos < tokens.size() ? tokens[current_pos] : Token();
+        diagnostics.push_back({ DiagCode::Error, error.what(), tok });
+    }
+
+    lineInputs.tracing = false;
+    bytesInLine = 0;
+    invalidateMemo();
+
+    size_t eol = tokens.nextEOL(std::max(current_pos, start));
+    if (diagnostics.size() >= maxErrors || eol == TokenStore::npos)
+        return false;
 
+    current_pos = eol + 1;
+    sourcePos = tokens.pos(eol);
+    return true;
+}
+
+/// <summary>
+/// Throws a ParseError for the current token.
+/// </summary>
+/// <param name="code">Kind of error.</param>
+/// <param name="str">Message.</param>
+void Parser::throwError(DiagCode code, std::string str) const
+{
+    Diagnostic diagnostic{ code, std::move(str), current_pos < tokens.size() ? tokens[current_pos] : Token() };
 
-        // Try to parse a line
-        auto line = parse_rule(RULE_TYPE::Line);
+    // the context is formatted when a collected diagnostic is printed
+    if (maxErrors > 1)
+        throw ParseError(diagnostic, diagnostic.message);
+    throw ParseError(diagnostic, format_diagnostic(diagnostic));
+}
+
+/// <summary>
+/// Formats a diagnostic as throwError reports it: the message followed by
+/// the token and the source lines around it.
+/// </summary>
+std::string Parser::format_diagnostic(const Diagnostic& diagnostic) const
+{
+    return diagnostic.message + " " + token_error_info(diagnostic.token);
+}
+
+/// <summary>
+/// Line bookkeeping once a line has been parsed: PC moves past the bytes of
+/// the line and is recorded in PCHistory for this pass.
+/// </summary>
+void Parser::end_line()
+{
+    PC += bytesInLine;
+    bytesInLine = 0;
+
+    while (static_cast<int>(PCHistory.size()) < pass) {
+        PCHistory.push_back(std::vector<int>());
+    }
+    assert(pass > 0);
+
+    PCHistory[pass - 1].push_back(PC);
+
+#ifdef __SHOW_SYM_CHANGE__
+    auto line = static_cast<int>(PCHistory[pass - 1].size());
+    if (pass > 1) {
+        auto oldv = PCHistory[pass - 2][line - 1];
+        auto newv = PCHistory[pass - 1][line - 1];
+        std::string change = ((oldv != newv) ? "CHANGE " : "");
+
+        std::cout << std::setfill(' ') << std::setw(10) << change
+            << "Line "
+            << std::dec << std::setfill(' ') << std::setw(4) << line << " "
+            << "$" << std::hex << std::setfill('0') << std::setw(4) << oldv << " => "
+            << "$" << std::hex << std::setfill('0') << std::setw(4) << newv << "\n"
+            << std::setw(0) << std::dec;
+    }
+#endif
+}
+
+/// <summary>
+/// Reads a symbol reference: a variable, a local symbol of the current scope
+/// or a global symbol, in that order.
+/// </summary>
+/// <param name="tok">The SYM or LOCALSYM token.</param>
+/// <param name="found">Set to false if the symbol is not defined.</param>
+/// <returns>The value of the symbol, 0 if it is not defined.</returns>
+int Parser::lookup_symbol(const Token& tok, bool& found)
+{
+    std::string name(tok.value);
+    found = true;
 
-        if (line) {
-            linelist->add_child(line);
+    if (varSymbols.isDefined(name)) {
+        // variables are runtime values; ignore source position when reading
+        return varSymbols[name].value;
+    }
+    if (tok.type == LOCALSYM) {
+        auto symname = scope + name;
+        return localSymbols.getSymValue(symname, tok.pos);
+    }
+    if (globalSymbols.isDefined(name)) {
+        return globalSymbols.getSymValue(name, tok.pos);
+    }
+    found = false;
+    return 0;
+}
+
+/// <summary>
+/// Moves the nodes of a replayed line to a new PC. Every node a line builds
+/// starts at the PC of the line; nodes left at 0 keep it.
+/// </summary>
+static void movePC(ASTNode& node, int32_t from, int32_t to)
+{
+    if (node.pc_Start == from)
+        node.pc_Start = to;
+    for (auto& child : node.children) {
+        if (auto sub = std::get_if<std::shared_ptr<ASTNode>>(&child))
+            movePC(**sub, from, to);
+    }
+}
+
+/// <summary>
+/// Reuses the nodes of the line recorded at this ordinal in an earlier pass.
+/// The line applies when its tokens are the ones at current_pos, every
+/// symbol it read has the same value and, if it read PC, PC is the same:
+/// the grammar would then build the same nodes and count the same bytes.
+/// </summary>
+/// <param name="ordinal">Index of the line in the LineList.</param>
+/// <returns>The Line node, or nullptr with nothing consumed.</returns>
+std::shared_ptr<ASTNode> Parser::replay_line(size_t ordinal)
+{
+    if (ordinal >= replayLines.size() || inMacroDefinition)
+        return nullptr;
+
+    ReplayLine& entry = replayLines[ordinal];
+    const size_t start = current_pos;
+    const size_t count = entry.tokens.size();
+    if (count == 0 || count > tokens.size() - start)
+        return nullptr;
+
+    // a node at 0 could not be told from one at the PC of the line
+    if (PC != entry.pc && (entry.readsPC || entry.pc == 0))
+        return nullptr;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (tokens.type(start + i) != entry.tokens[i].type || !(tokens[start + i] == entry.tokens[i]))
+            return nullptr;
+    }
+
+    // The label defines its symbol at PC (and sets the scope of local
+    // symbols) so it is parsed again. The grammar may parse it again too if
+    // the line does not apply, a label definition repeated at the same PC
+    // changes nothing.
+    const SourcePos startSource = sourcePos;
+    std::shared_ptr<ASTNode> label;
+    if (entry.labelTokens > 0) {
+        label = parse_rule(LabelDef);
+        if (!label || current_pos != start + entry.labelTokens) {
+            current_pos = start;
+            sourcePos = startSource;
+            return nullptr;
         }
-        else {
-            // If we are at the end, break, otherwise it's a syntax error
-            if (current_pos < tokens.size()) {
-                throwError("Unexpected token or syntax error");
+    }
+
+    for (auto& read : entry.symbols) {
+        bool found;
+        int value = lookup_symbol(read.token, found);
+        if (value != read.value || found != read.found) {
+            current_pos = start;
+            sourcePos = startSource;
+            return nullptr;
+        }
+    }
+
+    if (entry.pc != PC) {
+        if (entry.statement)
+            movePC(*entry.statement, entry.pc, PC);
+        movePC(*entry.eol, entry.pc, PC);
+        entry.pc = PC;
+    }
+
+    current_pos = start + count;
+    sourcePos = tokens.pos(current_pos - 1);
+    terminalsMatched += count - entry.labelTokens;
+    bytesInLine += entry.bytes;
+
+    // Line action
+    end_line();
+    auto line = makeNode(Line);
+    line->pc_Start = PC;
+    if (label)
+        line->add_child(label);
+    if (entry.statement)
+        line->add_child(entry.statement);
+    line->add_child(entry.eol);
+
+    auto& left = std::get<std::shared_ptr<ASTNode>>(line->children[0]);
+    line->sourcePosition = left->sourcePosition;
+    line->value = left->sourcePosition.line;
+
+    invalidateMemo();
+    ++linesReplayed;
+    return line;
+}
+
+/// <summary>
+/// Records a top-level line for replay_line when its nodes only depend on
+/// its tokens, the symbols it read (lineInputs) and PC: an instruction,
+/// .byte or .word (after a label or not) or a comment. Anything else is
+/// parsed every pass.
+/// </summary>
+/// <param name="ordinal">Index of the line in the LineList.</param>
+/// <param name="start">Token index of the line.</param>
+/// <param name="startPC">PC before the line.</param>
+/// <param name="line">The parsed Line node.</param>
+void Parser::record_line(size_t ordinal, size_t start, int32_t startPC, const std::shared_ptr<ASTNode>& line)
+{
+    if (replayLines.size() <= ordinal)
+        replayLines.resize(ordinal + 1);
+    ReplayLine& entry = replayLines[ordinal];
+    entry.tokens.clear();
+    entry.statement = nullptr;
+    entry.eol = nullptr;
+
+    if (!lineInputs.replayable || inMacroDefinition)
+        return;
+
+    std::shared_ptr<ASTNode> label, statement, eol;
+    for (auto& child : line->children) {
+        auto& node = std::get<std::shared_ptr<ASTNode>>(child);
+        switch (node->type) {
+            case LabelDef:      label = node; break;
+            case Statement:     statement = node; break;
+            case EOLOrComment:  eol = node; break;
+            default:            return;
+        }
+    }
+    if (!eol)
+        return;
+
+    // A label alone is left to the grammar: it defines the label a second
+    // time after the production with a statement fails, and the second,
+    // unchanged definition clears the changed flag of the symbol.
+    if (label && !statement)
+        return;
+
+    if (statement) {
+        auto& kind = std::get<std::shared_ptr<ASTNode>>(statement->children[0]);
+        if (kind->type != Op_Instruction && kind->type != ByteDirective && kind->type != WordDirective)
+            return;
+    }
+
+    const size_t labelTokens = label ? label->children.size() : 0;
+
+    entry.tokens = tokens.slice(start, current_pos);
+    entry.symbols = std::move(lineInputs.symbols);
+    entry.readsPC = lineInputs.readsPC;
+    entry.pc = startPC;
+    entry.bytes = PC - startPC;
+    entry.labelTokens = labelTokens;
+    entry.statement = statement;
+    entry.eol = eol;
+}
+
+/// <summary>
+/// Parses a .byte / .word line whose items are all number literals or
+/// strings straight into packed bytes. Data tables are most of the lines of
+/// many sources, and the grammar builds an Expr chain for every value.
+/// The nodes, positions, PC and match counts are the ones parse_rule(Line)
+/// would produce, with a DataBytes node in place of the ExprList.
+/// </summary>
+/// <returns>
+/// The Line node, or nullptr with nothing consumed when the line needs the
+/// grammar (any other statement, a label, an expression, a value that does
+/// not fit, a malformed list or a macro definition body).
+/// </returns>
+std::shared_ptr<ASTNode> Parser::parse_data_line()
+{
+    if (inMacroDefinition || current_pos >= tokens.size())
+        return nullptr;
+
+    const size_t start = current_pos;
+    const TOKEN_TYPE directive = tokens.type(start);
+    if (directive != BYTE && directive != WORD)
+        return nullptr;
+
+    const size_t eol = tokens.nextEOL(start);
+    if (eol == TokenStore::npos)
+        return nullptr;
+
+    const bool word = directive == WORD;
+    const int32_t maxValue = word ? 0xFFFF : 0xFF;
+
+    auto data = makeNode(DataBytes);
+    data->pc_Start = PC;
+    auto& bytes = data->data;
+    bytes.reserve((eol - start) / 2 * (word ? 2 : 1));
+
+    // item (, item)* up to the comment or EOL
+    std::vector<uint8_t> chars;
+    size_t i = start + 1;
+    while (true) {
+        if (i >= eol)
+            return nullptr;
+
+        switch (tokens.type(i)) {
+            case DECNUM:
+            case HEXNUM:
+            case BINNUM:
+            case OCTNUM:
+            case CHAR:
+            {
+                int32_t value = tokens.number(i);
+                if (value < 0 || value > maxValue)
+                    return nullptr;
+                bytes.push_back(static_cast<uint8_t>(value & 0xFF));
+                if (word)
+                    bytes.push_back(static_cast<uint8_t>(value >> 8));
+                break;
             }
-            break;
+
+            case TEXT:
+                sanitizeString(tokens.value(i), chars);
+                for (auto ch : chars) {
+                    bytes.push_back(ch);
+                    if (word)
+                        bytes.push_back(0);
+                }
+                break;
+
+            default:
+                return nullptr;
         }
+
+        if (tokens.type(++i) != COMMA)
+            break;
+        ++i;
     }
-    return root;
-#endif
+
+    const size_t listEnd = i;
+    if (tokens.type(i) == COMMENT)
+        ++i;
+    if (i != eol)
+        return nullptr;
+
+    // Byte/WordDirective action: count the bytes on the first match
+    const SourcePos& listPos = tokens.pos(listEnd - 1);
+    const int64_t rule = word ? WordDirective : ByteDirective;
+    data->sourcePosition = listPos;
+    if (ruleMatches.count(listEnd, rule) == 0)
+        bytesInLine += bytes.size();
+    ruleMatches.record(listEnd, rule);
+
+    auto directiveNode = makeNode(rule, listPos);
+    directiveNode->pc_Start = PC;
+    directiveNode->add_child(tokens[start]);
+    directiveNode->add_child(data);
+
+    auto statement = makeNode(Statement, listPos);
+    statement->pc_Start = PC;
+    statement->add_child(directiveNode);
+
+    auto eolNode = makeNode(EOLOrComment, tokens.pos(eol), tokens.pos(eol).line);
+    eolNode->pc_Start = PC;
+    if (listEnd != eol) {
+        auto comment = makeNode(Comment, tokens.pos(listEnd));
+        comment->pc_Start = PC;
+        comment->add_child(tokens[listEnd]);
+        eolNode->add_child(comment);
+    }
+    eolNode->add_child(tokens[eol]);
+
+    current_pos = eol + 1;
+    sourcePos = tokens.pos(eol);
+    terminalsMatched += current_pos - start;
+
+    // Line action
+    end_line();
+    auto line = makeNode(Line, statement->sourcePosition, statement->sourcePosition.line);
+    line->pc_Start = PC;
+    line->add_child(statement);
+    line->add_child(eolNode);
+
+    invalidateMemo();
+    return line;
 }
 
 //=============================================================================
@@ -136,10 +602,8 @@ std::shared_ptr<ASTNode> Parser::parse()
 /// </returns>
 size_t Parser::FindPrevEOL(size_t idx) const
 {
-    for (size_t i = idx; i > 0; --i) {
-        if (tokens[i - 1].type == EOL) return i - 1;
-    }
-    return (size_t)-1;  // No previous EOL found - we're at the start
+    // Looked up in the EOL index of the token store
+    return tokens.prevEOL(std::min(idx, tokens.size()));
 }
 
 /// <summary>
@@ -151,10 +615,11 @@ size_t Parser::FindPrevEOL(size_t idx) const
 /// <exception cref="std::runtime_error">Thrown if no EOL is found (malformed input).</exception>
 size_t Parser::FindNextEOL(size_t idx) const
 {
-    for (size_t i = idx; i < tokens.size(); ++i) {
-        if (tokens[i].type == EOL) return i;
+    size_t eol = tokens.nextEOL(idx);
+    if (eol == TokenStore::npos) {
+        throwError("Missing EOL while scanning tokens");
     }
-    throwError("Missing EOL while scanning tokens");
+    return eol;
 }
 
 /// <summary>
@@ -175,7 +640,9 @@ void Parser::EraseRange(size_t start, size_t endExclusive)
     if (start > tokens.size() || endExclusive > tokens.size()) return;
 
     // Erase the token range
-    tokens.erase(tokens.begin() + start, tokens.begin() + endExclusive);
+    recordErase(start, endExclusive);
+    tokens.erase(start, endExclusive);
+    invalidateMemo();
 
     // Adjust current parsing position to account for removed tokens
     if (current_pos >= start) {
@@ -192,58 +659,63 @@ void Parser::EraseRange(size_t start, size_t endExclusive)
 // Conditional Assembly Directive Handling (.if/.ifdef/.ifndef/.else/.endif)
 //=============================================================================
 
+/// <summary>
+/// Finds the conditional directive (.if/.ifdef/.ifndef) on the line that
+/// ends at or after afterDirectivePos.
+/// </summary>
+/// <param name="afterDirectivePos">Token position just after the directive's expression/symbol.</param>
+/// <returns>Token index of the directive.</returns>
+/// <exception cref="std::runtime_error">Thrown if the line has no conditional directive.</exception>
+size_t Parser::FindConditionalOpener(size_t afterDirectivePos) const
+{
+    size_t i = std::min(afterDirectivePos, tokens.size());
+    while (i-- > 0 && tokens.type(i) != EOL) {
+        switch (tokens.type(i)) {
+            case IF_DIR:
+            case IFDEF_DIR:
+            case IFNDEF_DIR:
+                return i;
+            default:
+                break;
+        }
+    }
+    throwError("Internal: conditional directive not found");
+}
+
 /// <summary>
 /// Finds the matching .else (if present) and .endif for a conditional directive.
-/// Properly handles nested conditional blocks by tracking depth.
+/// The token store matches conditionals as tokens are added (nested blocks
+/// included), so this follows the directive's links instead of scanning.
 /// </summary>
-/// <param name="from">The token index to start searching from (after the condition).</param>
+/// <param name="opener">Token index of the .if/.ifdef/.ifndef directive.</param>
 /// <returns>
 /// An ElseEndif struct containing:
 /// - elseIdx: Optional index of the .else directive (if present at current depth)
 /// - endifIdx: Index of the matching .endif directive
 /// </returns>
 /// <exception cref="std::runtime_error">Thrown if no matching .endif is found.</exception>
-Parser::ElseEndif Parser::FindMatchingElseEndif(size_t from) const
+Parser::ElseEndif Parser::FindMatchingElseEndif(size_t opener) const
 {
-    size_t depth = 1;  // Start at depth 1 for the initial conditional
-    std::optional<size_t> foundElse;  // Track first .else at our depth level
-
-    for (size_t i = from; i < tokens.size(); ++i) {
-        switch (tokens[i].type) {
-            case IF_DIR:
-            case IFDEF_DIR:
-            case IFNDEF_DIR:
-                ++depth;  // Entering a nested conditional block
-                break;
-
-            case ENDIF_DIR:
-                --depth;  // Exiting a conditional block
-                if (depth == 0) {
-                    return { foundElse, i };  // Found our matching .endif
-                }
-                break;
-
-            case ELSE_DIR:
-                // Only record .else at our depth level (depth == 1)
-                // and only the first one encountered
-                if (depth == 1 && !foundElse) {
-                    foundElse = i;
-                }
-                break;
-
-            default:
-                break;
-        }
+    std::optional<size_t> foundElse;
+    size_t next = tokens.partner(opener);
+    if (next != TokenStore::npos && tokens.type(next) == ELSE_DIR) {
+        foundElse = next;
+        next = tokens.partner(next);
     }
-    throwError("Unmatched .if/.ifdef/.ifndef (missing .endif)");
+    if (next == TokenStore::npos || tokens.type(next) != ENDIF_DIR)
+        throwError(DiagCode::Syntax, "Unmatched .if/.ifdef/.ifndef (missing .endif)");
+    return { foundElse, next };
 }
 
 /// <summary>
 /// Processes a conditional assembly directive by removing inactive code blocks.
 /// Handles .if, .ifdef, .ifndef directives with optional .else clauses.
 ///
-/// This function performs "splicing" - removing the directive lines and
-/// either the THEN block or ELSE block based on the condition result.
+/// This function performs "splicing" - removing the directive line and
+/// the lines that follow it up to the block that is kept. The lines after
+/// the kept block (.else..endif or .endif) are left in place: the directive
+/// stays linked to them and DropConditionalCloser removes them when the parse
+/// gets there, so no erase reaches past the parse position.
 /// </summary>
 /// <param name="cond">
 /// The evaluated condition result:
@@ -255,90 +727,54 @@ Parser::ElseEndif Parser::FindMatchingElseEndif(size_t from) const
 /// (i.e., pointing at or near the EOL of the directive line).
 /// </param>
 /// <remarks>
-/// The function removes tokens in reverse order (right to left) to maintain
-/// valid indices throughout the removal process.
-///
 /// Example for ".if COND" with ELSE:
 /// ```
-///   .if COND      <- directive line (always removed)
-///   THEN_CODE     <- kept if cond==true, removed if cond==false
-///   .else         <- structure line (always removed)
-///   ELSE_CODE     <- removed if cond==true, kept if cond==false
-///   .endif        <- structure line (always removed)
+///   .if COND      <- directive line (removed now)
+///   THEN_CODE     <- kept if cond==true, removed now if cond==false
+///   .else         <- removed now if cond==false, when reached if cond==true
+///   ELSE_CODE     <- removed when reached if cond==true, kept if cond==false
+///   .endif        <- removed when reached
 /// ```
 /// </remarks>
 void Parser::SpliceConditional(bool cond, size_t afterDirectivePos)
 {
     // afterDirectivePos is just after the expr/symbol on the directive line
     const size_t dirEOL = FindNextEOL(afterDirectivePos);
-    const size_t bodyStart = dirEOL + 1;  // First token of the conditional body
-
-    // Find matching .else (optional) and .endif BEFORE we start erasing
-    // (indices become invalid after erasing)
-    auto match = FindMatchingElseEndif(bodyStart);
-    const size_t endifIdx = match.endifIdx;
-
-    // Lambda: Find the start of the line containing a given token index
-    auto lineStart = [this](size_t anyIdx) -> size_t
-        {
-            size_t prev = FindPrevEOL(anyIdx);
-            return (prev == (size_t)-1) ? 0 : prev + 1;
-        };
-
-    // Lambda: Find the end of the line containing a given token index (exclusive)
-    auto lineEndEx = [this](size_t anyIdx) -> size_t
-        {
-            return FindNextEOL(anyIdx) + 1;
-        };
-
-    // Collect all ranges to erase (will sort and erase in reverse order)
-    std::vector<std::pair<size_t, size_t>> toErase;
-
-    // 1) Always remove the directive line itself (.if/.ifdef/.ifndef ...)
-    const size_t ifLineStart = lineStart(afterDirectivePos);
-    const size_t ifLineEndEx = dirEOL + 1;
-    toErase.emplace_back(ifLineStart, ifLineEndEx);
-
-    // 2) Determine what else to remove based on condition and presence of .else
-    const size_t endifLineStart = lineStart(endifIdx);
-    const size_t endifLineEndEx = lineEndEx(endifIdx);
+    const size_t opener = FindConditionalOpener(afterDirectivePos);
+    auto match = FindMatchingElseEndif(opener);
+
+    const size_t prev = FindPrevEOL(opener);
+    const size_t ifLineStart = (prev == (size_t)-1) ? 0 : prev + 1;
 
     if (cond) {
-        // Condition is TRUE: Keep THEN body, remove ELSE..ENDIF section
-        if (match.elseIdx) {
-            // Has .else: Remove from .else line through .endif line
-            const size_t elseIdx = *match.elseIdx;
-            const size_t elseLineStart = lineStart(elseIdx);
-            toErase.emplace_back(elseLineStart, endifLineEndEx);
-        }
-        else {
-            // No .else: Only remove the .endif line
-            toErase.emplace_back(endifLineStart, endifLineEndEx);
-        }
+        // Condition is TRUE: Keep THEN body, the .else/.endif lines wait
+        EraseRange(ifLineStart, dirEOL + 1);
+    }
+    else if (match.elseIdx) {
+        // Condition is FALSE with .else: Remove directive, THEN body and .else line
+        EraseRange(ifLineStart, FindNextEOL(*match.elseIdx) + 1);
     }
     else {
-        // Condition is FALSE: Remove THEN body, keep ELSE body (if present)
-        if (match.elseIdx) {
-            // Has .else: Remove THEN body and .else line, then .endif line
-            const size_t elseIdx = *match.elseIdx;
-            const size_t elseLineEndEx = lineEndEx(elseIdx);
-            toErase.emplace_back(bodyStart, elseLineEndEx);        // Drop THEN body and .else line
-            toErase.emplace_back(endifLineStart, endifLineEndEx);  // Drop .endif line
-        }
-        else {
-            // No .else: Remove entire THEN body through .endif
-            toErase.emplace_back(bodyStart, endifLineEndEx);
-        }
+        // Condition is FALSE without .else: Remove directive through .endif line
+        EraseRange(ifLineStart, FindNextEOL(match.endifIdx) + 1);
     }
 
-    // Sort ranges in descending order by start position
-    // This ensures we erase from right to left, keeping earlier indices valid
-    std::sort(toErase.begin(), toErase.end(),
-        [](auto& a, auto& b) { return a.first > b.first; });
+    // the kept block may be empty: the rest of the directive's line is
+    // parsed on the line after it
+    DropConditionalCloser();
+}
 
-    // Perform the erasures
-    for (auto& r : toErase) {
-        EraseRange(r.first, r.second);
+/// <summary>
+/// Removes the .else or .endif line at current_pos left by SpliceConditional
+/// (a .else takes its body and .endif line with it). Other lines are left.
+/// </summary>
+void Parser::DropConditionalCloser()
+{
+    while (current_pos < tokens.size() && tokens.openerErased(current_pos)) {
+        size_t last = current_pos;
+        if (tokens.type(current_pos) == ELSE_DIR)
+            last = tokens.partner(current_pos);     // its .endif
+        EraseRange(current_pos, FindNextEOL(last) + 1);
     }
 }
 
@@ -369,7 +805,7 @@ std::shared_ptr<ASTNode> Parser::Pass()
 /// </summary>
 void Parser::reset_rules()
 {
-    rule_processed.clear();
+    ruleMatches.clear();
 }
 
 /// <summary>
@@ -388,7 +824,14 @@ void Parser::InitPass()
     }
 
     // Clear rule processing history
-    rule_processed.clear();
+    ruleMatches.clear();
+
+    diagnostics.clear();
+
+    // Drop saved states and the token edit journal
+    parseStack = {};
+    tokenEdits.clear();
+    journaling = false;
 
     // Reset anonymous label tracking (for +/- relative labels)
     anonLabels.reset();
@@ -418,7 +861,7 @@ std::vector<Token> Parser::applyPendingExpansions(const std::vector<Token>& toke
     for (size_t i = 0; i < tokens.size(); ) {
         if (tokens[i].type == DO_DIR) {
             // Create key from token's position
-            auto key = std::make_pair(tokens[i].pos.filename, tokens[i].pos.line);
+            auto key = std::make_pair(tokens[i].pos.filename(), tokens[i].pos.line);
             auto it = pendingLoopExpansions.find(key);
 
             if (it != pendingLoopExpansions.end()) {
@@ -462,64 +905,97 @@ std::vector<Token> Parser::applyPendingExpansions(const std::vector<Token>& toke
 //=============================================================================
 
 /// <summary>
-/// Reads a source file and returns its contents as a vector of lines.
-/// Implements file caching to avoid re-reading files on subsequent passes.
+/// Resolves the name a source file is read and cached under.
+/// The name is used as given when the file opens directly; otherwise each of
+/// includeDirectories is searched in order.
+/// </summary>
+/// <param name="filename">The path to the file to read.</param>
+/// <returns>The resolved file name.</returns>
+/// <exception cref="std::runtime_error">Thrown if the file cannot be found.</exception>
+std::string Parser::resolveFilename(const std::string& filename)
+{
+    namespace fs = std::filesystem;
+
+    if (fileCache.contains(filename))
+        return filename;
+
+    // Try opening the file directly first
+    fs::path requested_path = fs::absolute(fs::path(filename)).lexically_normal();
+    if (std::ifstream(requested_path))
+        return filename;
+
+    // File not found in direct path, search through includeDirectories
+    for (const auto& dir : includeDirectories) {
+        fs::path include_path = fs::absolute(fs::path(dir) / filename).lexically_normal();
+        if (std::ifstream(include_path))
+            return include_path.string();
+    }
+
+    throwError(DiagCode::File, "Could not open file: " + filename);
+    return filename;
+}
+
+/// <summary>
+/// Reads a source file and returns its lines.
+/// The file is memory mapped and indexed once; later reads of the same file
+/// (subsequent passes, listings, diagnostics) return the cached lines.
 /// Searches through includeDirectories if the file is not found in the current path.
 /// </summary>
 /// <param name="filename">The path to the file to read.</param>
 /// <returns>
-/// A vector of pairs, each containing:
-/// - SourcePos: The file name and line number for error reporting
-/// - std::string: The actual line content
+/// The file's lines. Line i has the position (filename, i + 1) and views the mapped text.
 /// </returns>
 /// <exception cref="std::runtime_error">Thrown if the file cannot be opened.</exception>
-std::vector<std::pair<SourcePos, std::string>> Parser::readfile(std::string filename)
+const SourceText& Parser::readfile(std::string filename)
 {
     namespace fs = std::filesystem;
-    std::vector<std::pair<SourcePos, std::string>> lines;
-
-    // Check if file is already cached
-    if (!fileCache.contains(filename)) {
-        // Normalize the requested filename to an absolute path
-        fs::path requested_path = fs::absolute(fs::path(filename)).lexically_normal();
-        std::ifstream incfile;
-        std::string resolved_filename = filename;
-
-        // Try opening the file directly first
-        incfile.open(requested_path);
-        if (!incfile) {
-            // File not found in direct path, search through includeDirectories
-            bool found = false;
-            for (const auto& dir : includeDirectories) {
-                fs::path include_path = fs::absolute(fs::path(dir) / filename).lexically_normal();
-                incfile.open(include_path);
-                if (incfile) {
-                    resolved_filename = include_path.string();
-                    found = true;
-                    break;
-                }
-            }
 
-            if (!found) {
-                throwError("Could not open file: " + filename);
-            }
-        }
+    filename = resolveFilename(filename);
 
-        // Read line by line, preserving source positions for error reporting
-        std::string line;
-        int l = 0;
-        while (std::getline(incfile, line)) {
-            lines.push_back({ SourcePos(resolved_filename, ++l), line });
-        }
-        filename = resolved_filename;
+    // Return cached contents
+    auto cached = fileCache.find(filename);
+    if (cached != fileCache.end())
+        return cached->second;
 
-        // Cache the file contents for subsequent passes
-        fileCache[filename] = lines;
-        return lines;
+    auto path = fs::absolute(fs::path(filename)).lexically_normal().string();
+    if (!std::ifstream(path)) {
+        throwError(DiagCode::File, "Could not open file: " + filename);
     }
 
-    // Return cached contents
-    return fileCache[filename];
+    // Cache the file contents for subsequent passes
+    return fileCache.emplace(filename, SourceText(filename, retainSourceFile(path))).first->second;
+}
+
+/// <summary>
+/// Returns the tokens of an included file, led by an EOL token.
+/// Files are read and tokenized once per resolved path; later includes of the
+/// same file (in this pass or any later pass) reuse the cached tokens. The first
+/// tokenization goes through the on-disk token cache when one is configured.
+/// </summary>
+/// <param name="filename">The file name as written in the .include directive.</param>
+/// <returns>The cached token vector.</returns>
+/// <exception cref="std::runtime_error">Thrown if the file cannot be opened.</exception>
+const TokenStore& Parser::includeTokens(const std::string& filename)
+{
+    auto resolved = resolveFilename(filename);
+
+    auto cached = includeCache.find(resolved);
+    if (cached != includeCache.end()) {
+        ++includeCacheHits;
+        return cached->second;
+    }
+    ++includeCacheMisses;
+
+    auto tokens = tokenCache.tokenize(readfile(resolved));
+
+    TokenStore inctokens;
+    inctokens.reserve(tokens.size() + 1);
+
+    Token eolTok;
+    eolTok.type = TOKEN_TYPE::EOL;
+    inctokens.push_back(eolTok);
+    inctokens.insert(inctokens.size(), tokens);
+    return includeCache.emplace(resolved, std::move(inctokens)).first->second;
 }
 
 //=============================================================================
@@ -533,7 +1009,7 @@ std::vector<std::pair<SourcePos, std::string>> Parser::readfile(std::string file
 /// <param name="index">The index of the token to print.</param>
 void Parser::printToken(int index)
 {
-    auto& tok = tokens[index];
+    auto tok = tokens[index];
     std::cout <<
         "[" <<
         std::setw(4) <<
@@ -614,7 +1090,9 @@ void Parser::RemoveCurrentLine()
 
     // Erase the entire line
     if (begin < end && end <= tokens.size()) {
-        tokens.erase(tokens.begin() + begin, tokens.begin() + end);
+        recordErase(begin, end);
+        tokens.erase(begin, end);
+        invalidateMemo();
         current_pos = begin;  // Position to parse any inserted expansion next
     }
 }
@@ -657,8 +1135,9 @@ void Parser::RemoveLineRange(size_t start_pos, size_t end_pos)
     size_t removed_count = remove_end - remove_begin;
 
     // Perform the erasure
-    tokens.erase(tokens.begin() + remove_begin,
-        tokens.begin() + remove_end);
+    recordErase(remove_begin, remove_end);
+    tokens.erase(remove_begin, remove_end);
+    invalidateMemo();
 
     // Adjust current_pos relative to the removed range
     if (current_pos < remove_begin) {
@@ -687,19 +1166,99 @@ void Parser::RemoveLineRange(size_t start_pos, size_t end_pos)
 /// After insertion, current_pos is set to the insertion point so the
 /// parser will process the newly inserted tokens immediately.
 /// </remarks>
-void Parser::InsertTokens(int pos, std::vector<Token>& tok)
+void Parser::InsertTokens(int pos, const std::vector<Token>& tok)
 {
     // Clamp position to valid range
     if (pos < 0) pos = 0;
     if (pos > static_cast<int>(tokens.size())) pos = static_cast<int>(tokens.size());
 
     // Insert the tokens
-    tokens.insert(tokens.begin() + pos, tok.begin(), tok.end());
+    tokens.insert(pos, tok);
+    recordInsert(pos, tok.size());
+    invalidateMemo();
 
     // Set position to process the expansion immediately
     current_pos = pos;
 }
 
+/// <summary>
+/// Inserts tokens already held in a TokenStore (e.g. a cached include) at the
+/// specified position. Same semantics as the vector overload.
+/// </summary>
+void Parser::InsertTokens(int pos, const TokenStore& tok)
+{
+    if (pos < 0) pos = 0;
+    if (pos > static_cast<int>(tokens.size())) pos = static_cast<int>(tokens.size());
+
+    tokens.insert(pos, tok);
+    recordInsert(pos, tok.size());
+    invalidateMemo();
+    current_pos = pos;
+}
+
+//=============================================================================
+// Packrat Memo
+//=============================================================================
+
+/// <summary>
+/// Drops every memoized parse. Called when the token stream is spliced or the
+/// parser state a pure rule reads (symbols, PC, scope) may have changed.
+/// </summary>
+void Parser::invalidateMemo()
+{
+    if (!memoUsed) return;
+    memoUsed = false;
+    if (++memoStamp == 0) {
+        for (auto& entry : memo) entry.stamp = 0;
+        memoStamp = 1;
+    }
+    ++memoInvalidations;
+}
+
+// Positions a memo covers past its first entry (bounds the table size)
+static constexpr size_t MEMO_WINDOW = 1024;
+
+/// <summary>
+/// Memo entry for a rule slot at a token position.
+/// </summary>
+/// <param name="pos">Token position.</param>
+/// <param name="slot">Memo slot of the rule (CompiledRule::memoSlot).</param>
+/// <param name="grow">Start a memo or extend the table to hold the entry.</param>
+/// <returns>The entry, or nullptr if the position is outside the memo.</returns>
+Parser::MemoEntry* Parser::memoEntry(size_t pos, int slot, bool grow)
+{
+    if (!memoUsed) {
+        if (!grow) return nullptr;
+        memoUsed = true;
+        memoBase = pos;
+    }
+    if (pos < memoBase || pos - memoBase >= MEMO_WINDOW) return nullptr;
+
+    const size_t slots = compiledGrammar().memoSlots;
+    size_t index = (pos - memoBase) * slots + slot;
+    if (index >= memo.size()) {
+        if (!grow) return nullptr;
+        memo.resize(index + slots);
+    }
+    return &memo[index];
+}
+
+/// <summary>
+/// Tracks parse_rule nesting. Entering the outermost call drops the memo,
+/// since tokens and state may have been changed directly between calls.
+/// </summary>
+struct RuleDepthGuard {
+    Parser& p;
+    int& depth;
+
+    RuleDepthGuard(Parser& parser, int& d) : p(parser), depth(d)
+    {
+        if (depth++ == 0)
+            p.invalidateMemo();
+    }
+    ~RuleDepthGuard() { --depth; }
+};
+
 //=============================================================================
 // Core Recursive Descent Parser
 //=============================================================================
@@ -723,17 +1282,52 @@ void Parser::InsertTokens(int pos, std::vector<Token>& tok)
 /// to construct the appropriate AST node.
 ///
 /// If a production fails to match, the parser backtracks to try the next alternative.
+/// Alternatives whose FIRST set (grammar_rule.cpp) does not hold the current
+/// token type are skipped without being tried.
+///
+/// Rules are read from the compiled grammar (compiledGrammar), which holds
+/// grammar_rules as flat arrays indexed by rule id.
+///
+/// Pure rules (RuleHandler::pure) are memoized by (token position, rule): the
+/// alternatives of a rule often start with the same sub-rules (every opcode
+/// form starts with OpCode, most operands are an Expr), so a failed alternative
+/// leaves its sub-parses for the next one. Only actions of impure rules change
+/// the state pure rules read, so the memo is dropped after each of them.
 /// </remarks>
 std::shared_ptr<ASTNode> Parser::parse_rule(int64_t rule_type)
 {
     // Look up the rule definition in the grammar
-    auto rule_it = grammar_rules.find(rule_type);
-    if (rule_it == grammar_rules.end()) {
+    const CompiledGrammar& grammar = compiledGrammar();
+    const CompiledRule* rule = grammar.rule(rule_type);
+    if (!rule) {
         std::cout << "No rule found for type: " << parserDict[rule_type] << "\n";
         return nullptr;
     }
 
-    const RuleHandler& rule = rule_it->second;
+    ++ruleCalls;
+    RuleDepthGuard depthGuard(*this, ruleDepth);
+
+    // a line of a loop or macro body may close a conditional taken before it
+    // (before the first token check: no rule starts with .else or .endif)
+    if (rule_type == Line || rule_type == LineList) {
+        DropConditionalCloser();
+    }
+
+    const int memo_slot = memoize ? rule->memoSlot : -1;
+    const size_t memo_start = current_pos;
+    const size_t memo_terminals = terminalsMatched;
+    if (memo_slot >= 0) {
+        auto entry = memoEntry(current_pos, memo_slot, false);
+        if (entry && entry->stamp == memoStamp) {
+            ++memoHits;
+            memoTokensSaved += entry->end - memo_start;
+            current_pos = entry->end;
+            if (entry->setsSourcePos)
+                sourcePos = entry->sourcePos;
+            return entry->node;
+        }
+    }
+
     // ===== NEW: Defer variable updates during loop structure parsing =====
    
     bool savedDefer = deferVariableUpdates;
@@ -742,15 +1336,23 @@ std::shared_ptr<ASTNode> Parser::parse_rule(int64_t rule_type)
     }
 
     // =====================================================================
-    // Try each production alternative for this rule
-    for (const auto& production : rule.productions) {
+    // Try each production alternative for this rule, skipping those that
+    // cannot start with the current token
+    const CompiledProduction* productions = grammar.productions.data() + rule->firstProduction;
+    for (uint32_t alt = 0; alt < rule->productionCount; ++alt) {
+        const CompiledProduction& production = productions[alt];
+        TOKEN_TYPE next = current_pos < tokens.size() ? tokens.type(current_pos) : TOKEN_TYPE::LAST;
+        if (!production.start.admits(next))
+            continue;
+
         size_t start_pos = current_pos;     // Save position for backtracking
         std::vector<RuleArg> args;          // Collect matched elements
+        args.reserve(production.size);
         bool match = true;
 
-        // production[0] is the rule type itself, actual elements start at index 1
-        for (size_t i = 1; i < production.size(); ++i) {
-            int64_t expected = production[i];
+        const int32_t* elements = grammar.elements.data() + production.first;
+        for (uint32_t i = 0; i < production.size; ++i) {
+            int64_t expected = elements[i];
 
             if (expected < 0) {
                 // Non-terminal: Recursively parse the sub-rule 
@@ -765,14 +1367,15 @@ std::shared_ptr<ASTNode> Parser::parse_rule(int64_t rule_type)
             else {
                 // Terminal: Match against current token
                 if (current_pos >= tokens.size() ||
-                    tokens[current_pos].type != expected) {
+                    tokens.type(current_pos) != expected) {
                     match = false;
                     break;
                 }
                 // Consume the token and track source position for error reporting
-                auto& tok = tokens[current_pos++];
+                auto tok = tokens[current_pos++];
                 sourcePos = tok.pos;
-                args.push_back(tok);
+                ++terminalsMatched;
+                args.push_back(std::move(tok));
             }
         }
 
@@ -780,11 +1383,7 @@ std::shared_ptr<ASTNode> Parser::parse_rule(int64_t rule_type)
             // Successfully matched this production
             // Track how many times this rule matched at this position
             // (used for handling repeated/recursive rules)
-            auto pair = std::make_pair(current_pos, rule_type);
-            int count = 0;
-            if (rule_processed.find(pair) != rule_processed.end()) {
-                count = rule_processed[pair];
-            }
+            int count = ruleMatches.count(current_pos, rule_type);
             
             //if (count == 0) {
             //    // Invoke the rule's semantic action to build the AST node
@@ -795,8 +1394,18 @@ std::shared_ptr<ASTNode> Parser::parse_rule(int64_t rule_type)
             //    std::cout << "Rule matched: " << parserDict[rule_type] << " linepos " << tokens[current_pos - 1].line_pos << " ";
             //    tokens[current_pos -1].pos.print();
             //}
-            auto result = rule.action(*this, args, count);
-            rule_processed[pair] = ++count;
+            auto result = rule->action(*this, args, count);
+            ruleMatches.record(current_pos, rule_type);
+
+            if (memo_slot >= 0) {
+                if (auto entry = memoEntry(memo_start, memo_slot, true)) {
+                    ++memoMisses;
+                    *entry = MemoEntry{ result, current_pos, sourcePos, memoStamp, terminalsMatched != memo_terminals };
+                }
+            }
+            else if (!rule->pure) {
+                invalidateMemo();
+            }
 
             return result;
         }
@@ -808,11 +1417,131 @@ std::shared_ptr<ASTNode> Parser::parse_rule(int64_t rule_type)
     // ===== NEW: Restore defer flag on no match =====
     deferVariableUpdates = savedDefer;
 
+    if (memo_slot >= 0) {
+        if (auto entry = memoEntry(memo_start, memo_slot, true)) {
+            ++memoMisses;
+            *entry = MemoEntry{ nullptr, current_pos, sourcePos, memoStamp, terminalsMatched != memo_terminals };
+        }
+    }
+
     // ================================================
     // No production matched for this rule
     return nullptr;
 }
 
+/// <summary>
+/// Matches one terminal the way parse_rule does: consumes the token and
+/// tracks its source position.
+/// </summary>
+/// <param name="type">Expected token type.</param>
+/// <param name="args">Receives the token when it matches.</param>
+/// <returns>True if the current token had the type.</returns>
+bool Parser::match_token(TOKEN_TYPE type, std::vector<RuleArg>& args)
+{
+    if (current_pos >= tokens.size() || tokens.type(current_pos) != type)
+        return false;
+
+    auto tok = tokens[current_pos++];
+    sourcePos = tok.pos;
+    ++terminalsMatched;
+    args.push_back(std::move(tok));
+    return true;
+}
+
+//=============================================================================
+// Expression Operators
+//=============================================================================
+
+/// <summary>
+/// Binary operator entry of the binding power table.
+/// </summary>
+struct BinaryOperator {
+    uint8_t power = 0;              // binding power, 0 = not a binary operator
+    const char* operand = nullptr;  // right operand name used in errors
+};
+
+/// <summary>
+/// Binding power of each token type as a binary operator, lowest to highest:
+/// || && | ^ & (== !=) (< > <= >=) (<< >>) (+ -) (* / %).
+/// </summary>
+static constexpr std::array<BinaryOperator, TOKEN_TYPE::LAST> binaryOperators = []
+{
+    std::array<BinaryOperator, TOKEN_TYPE::LAST> ops{};
+    ops[LOGICAL_OR] = { 1, "a logical or expression" };
+    ops[LOGICAL_AND] = { 2, "a logical and expression" };
+    ops[BIT_OR] = { 3, "an or expression" };
+    ops[BIT_XOR] = { 4, "an or expression" };
+    ops[BIT_AND] = { 5, "an equality expression" };
+    ops[DEQUAL] = ops[NOTEQUAL] = { 6, "a relational expression" };
+    ops[LT] = ops[GT] = ops[LE] = ops[GE] = { 7, "a shift expression" };
+    ops[SLEFT] = ops[SRIGHT] = { 8, "a term" };
+    ops[PLUS] = ops[MINUS] = { 9, "a term" };
+    ops[MUL] = ops[DIV] = ops[MOD] = { 10, "a factor" };
+    return ops;
+}();
+
+/// <summary>
+/// Parses the binary operators following an operand by precedence climbing.
+/// </summary>
+/// <param name="left">Value of the operand already parsed.</param>
+/// <param name="min_power">Lowest binding power this call consumes.</param>
+/// <returns>Value of the expression.</returns>
+/// <remarks>
+/// Operands are Factors, so unary operators, parentheses, numbers, symbols and
+/// anonymous label references keep their grammar rules. The operator token
+/// itself does not update sourcePos (only operand tokens do).
+/// </remarks>
+int32_t Parser::parse_operators(int32_t left, int min_power)
+{
+    while (current_pos < tokens.size()) {
+        auto op = tokens.type(current_pos);
+        const auto& info = binaryOperators[op];
+        if (info.power == 0 || info.power < min_power)
+            break;
+
+        auto opValue = tokens.value(current_pos++);
+        auto operand = parse_rule(Factor);
+        if (!operand) {
+            throwError(DiagCode::Syntax,
+                "Syntax error: expected " + std::string(info.operand) +
+                " after operator '" + std::string(opValue) + "'"
+            );
+        }
+
+        // operators binding tighter than op belong to the right operand
+        int32_t l = left;
+        int32_t r = parse_operators(operand->value, info.power + 1);
+        switch (op) {
+            case LOGICAL_OR:  left = l || r ? 1 : 0; break;
+            case LOGICAL_AND: left = l && r ? 1 : 0; break;
+            case BIT_OR:      left = l | r; break;
+            case BIT_XOR:     left = l ^ r; break;
+            case BIT_AND:     left = l & r; break;
+            case DEQUAL:      left = l == r ? 1 : 0; break;
+            case NOTEQUAL:    left = l != r ? 1 : 0; break;
+            case LT:          left = l < r ? 1 : 0; break;
+            case GT:          left = l > r ? 1 : 0; break;
+            case LE:          left = l <= r ? 1 : 0; break;
+            case GE:          left = l >= r ? 1 : 0; break;
+            case SLEFT:       left = l << r; break;
+            case SRIGHT:      left = l >> r; break;
+            case PLUS:        left = l + r; break;
+            case MINUS:       left = l - r; break;
+            case MUL:         left = l * r; break;
+            case DIV:
+            case MOD:
+                if (r == 0) {
+                    throwError("Division by zero");
+                }
+                left = op == DIV ? l / r : l % r;
+                break;
+            default:
+                break;
+        }
+    }
+    return left;
+}
+
 //=============================================================================
 // String Utility Functions
 //=============================================================================
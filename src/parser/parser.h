@@ -16,14 +16,22 @@
 // Important conventions:
 //  - SourcePos::line is 1-based across the codebase.
 //  - `tokens` includes EOL tokens so line boundaries can be located by scanning
-//    for EOL token markers.
-//  - Parser maintains a fileCache mapping filenames to cached source lines
-//    (used for diagnostics, macro extraction and retokenization).
+//    for EOL token markers. It is a structure-of-arrays TokenStore
+//    (token_store.h); scans and terminal matches read tokens.type(i) and
+//    tokens[i] rebuilds a full Token.
+//  - Parser maintains a fileCache mapping filenames to their memory mapped
+//    lines (source_text.h; used for diagnostics, macro extraction, listings
+//    and retokenization) and an includeCache of tokenized include files
+//    reused across passes.
+//  - Passes after the first reuse the nodes of the top-level lines whose
+//    tokens and inputs did not change instead of parsing them (replay_line).
 #pragma once
 #include <map>
 #include <algorithm>
+#include <charconv>
 #include <memory>
 #include <set>
+#include <stack>
 #include <stdexcept>
 #include <vector>
 #include <filesystem>
@@ -33,8 +41,14 @@
 #include "ast_source_extractor.h"
 #include "ANSI_esc.h"
 #include "common_types.h"
+#include "diagnostic.h"
 #include "expr_rules.h"
 #include "grammar_rule.h"
+#include "node_pool.h"
+#include "rule_matches.h"
+#include "source_buffer.h"
+#include "source_text.h"
+#include "token_store.h"
 
 #include "sym.h"
 #include "symboltable.h"
@@ -75,7 +89,7 @@ public:
     void print()
     {
         for (auto& [pos, src] : bodyText) {
-            std::cout << pos.filename << "  " << pos.line << ")  " << src << "\n";
+            std::cout << pos.filename() << "  " << pos.line << ")  " << src << "\n";
         }
         std::cout << "\n";
     }
@@ -92,12 +106,14 @@ extern void setmacroscope(std::string name, int pc, std::shared_ptr<ASTNode>& no
  Lightweight POD capturing the parser's mutable runtime state so it can be
  saved/restored while performing nested parsing tasks (macro expansion,
  speculative parsing, etc.).
+ The token stream is not copied: tokenEdits marks the parser's token edit
+ journal, and restoring undoes the edits recorded after the mark.
 */
 struct ParseState {
     std::string filename;
     size_t current_pos;
     SourcePos current_source;
-    std::vector<Token> tokens;
+    size_t tokenEdits;
     int32_t PC;
     uint32_t bytesInLine;
 };
@@ -132,55 +148,76 @@ public:
     /*
     throwError
     ----------
-    Throw a runtime_error containing the provided message plus token
-    context information produced by get_token_error_info(). Marked [[noreturn]].
+    Throw a ParseError (diagnostic.h) for the current token. Its what() is the
+    message plus the token context produced by get_token_error_info(), or
+    just the message when errors are collected (the context is formatted
+    when the diagnostic is printed). Marked [[noreturn]].
     */
     [[noreturn]]
     void throwError(std::string str) const
     {
-        throw std::runtime_error(
-            str + " " + get_token_error_info()
-        );
+        throwError(DiagCode::Error, std::move(str));
     }
 
+    [[noreturn]]
+    void throwError(DiagCode code, std::string str) const;
+
+    /*
+    Error collection
+    ----------------
+    With maxErrors above 1 an error does not end the pass: parse() records
+    its Diagnostic, skips to the next line and goes on until maxErrors errors
+    were found. Assemble stops after a pass with errors and prints them.
+    */
+    size_t maxErrors = 1;
+    std::vector<Diagnostic> diagnostics;
+
+    // Diagnostic message followed by the source lines around its token
+    std::string format_diagnostic(const Diagnostic& diagnostic) const;
+
     /*
      getCurrentState / setCurrentState
      ---------------------------------
      Save and restore a compact ParseState snapshot. Used when exploring or
      re-writing token ranges (macro expansion, nested parsing, etc.).
+     - Taking a state starts journaling token edits (EraseRange,
+       RemoveCurrentLine, RemoveLineRange, InsertTokens) for the rest of the
+       pass; restoring undoes the edits made since, so both cost time in
+       proportion to the edits rather than the token stream.
+     - States restore in stack order: restoring one drops the journal after
+       it, so states taken later can no longer be restored.
+     - Assigning `tokens` directly is not journaled.
     */
     ParseState getCurrentState()
     {
+        journaling = true;
         return ParseState
         {
             .filename = filename,
             .current_pos = current_pos,
             .current_source = sourcePos,
-            .tokens = tokens,
+            .tokenEdits = tokenEdits.size(),
             .PC = PC,
             .bytesInLine = bytesInLine,
         };
     }
 
-    void setCurrentState(ParseState& state)
-    {
-        filename = state.filename;
-        current_pos = state.current_pos;
-        sourcePos = state.current_source;
-        tokens = state.tokens;
-        PC = state.PC;
-        bytesInLine = state.bytesInLine;
-    }
+    void setCurrentState(const ParseState& state);
 
     // Token stream manipulation helpers (implementations in parser.cpp)
     void RemoveCurrentLine();
     void RemoveLineRange(size_t start_pos, size_t end_pos);
-    void InsertTokens(int pos, std::vector<Token>& tok);
+    void InsertTokens(int pos, const std::vector<Token>& tok);
+    void InsertTokens(int pos, const TokenStore& tok);
     void printToken(int index);
     void printTokens(int start, int end);
     void printTokens(std::vector<Token>& tokens);
     void printTokens();
-    std::vector<std::pair<SourcePos, std::string>> readfile(std::string filename);
+    const SourceText& readfile(std::string filename);
+    std::string resolveFilename(const std::string& filename);
+
+    // Tokens of an included file (led by an EOL), tokenized once per resolved path.
+    const TokenStore& includeTokens(const std::string& filename);
 
     /// <summary>
     /// When true, variable assignments are deferred (not executed).
@@ -191,7 +228,7 @@ public:
 
     // Current source/parse context
     std::string filename;
-    std::vector<Token> tokens;
+    TokenStore tokens;
     std::string scope;
 
     // Default origin and program counter (org / PC)
@@ -213,14 +250,37 @@ public:
     // Mapping of token types -> human-readable name used for diagnostics
     std::map<int64_t, std::string> parserDict;
 
-    // Cached file contents: filename -> vector of (SourcePos, line_text)
-    std::map<std::string, std::vector<std::pair<SourcePos, std::string>>> fileCache;
+    // Cached file contents: filename -> mapped text and line index
+    std::map<std::string, SourceText> fileCache;
+
+    // Tokenized include files: resolved path -> tokens. Kept for the whole run so
+    // each .include is lexed once rather than once per pass.
+    std::map<std::string, TokenStore> includeCache;
+    size_t includeCacheHits = 0;
+    size_t includeCacheMisses = 0;
+
+    // Packrat memo of pure rule parses (RuleHandler::pure), keyed by token
+    // position and rule, so backtracking never parses an expression, opcode or
+    // symbol reference twice at the same position. See parse_rule. Off by
+    // default: every token splice (macro, .fill, .if) drops the memo, so on
+    // most sources it costs more than the parses it saves.
+    bool memoize = false;
+    size_t memoHits = 0;            // parses answered from the memo
+    size_t memoMisses = 0;          // parses recorded in the memo
+    size_t memoTokensSaved = 0;     // tokens not parsed again because of hits
+    size_t memoInvalidations = 0;   // times a non-empty memo was dropped
+
+    // parse_rule calls (rule lookups), for measuring the cost per call
+    size_t ruleCalls = 0;
+
+    // Drop all memo entries (token stream or parser state changed).
+    void invalidateMemo();
 
     // Indicates currently inside a macro definition (suppresses some side-effects)
     bool inMacroDefinition = false;
 
-    // Push/pop full parse state for nested parsing contexts (e.g., macro expansion)
-    void pushParseState(ParseState& state);
+    // Push/pop parse state for nested parsing contexts (e.g., macro expansion)
+    void pushParseState(const ParseState& state);
     ParseState popParseState();
 
     // Diagnostic helpers to print symbol tables
@@ -234,34 +294,6 @@ public:
         varSymbols.print(true);
     }
 
-    /*
-     eval_number
-     -----------
-     Convert textual numeric token into a numeric value depending on
-     the token type (DECNUM / HEXNUM / BINNUM / CHAR). Uses std::strtol
-     with the appropriate base; for CHAR returns the first character code.
-    */
-    uint16_t eval_number(std::string num, TOKEN_TYPE tok)
-    {
-        switch (tok) {
-            case DECNUM:
-                return std::strtol(num.substr(0).c_str(), nullptr, 10);
-
-            case HEXNUM:
-                return std::strtol(num.substr(1).c_str(), nullptr, 16);
-
-            case BINNUM:
-                return std::strtol(num.substr(1).c_str(), nullptr, 2);
-
-            case CHAR:
-                return num[0];
-
-            default:
-                break;
-        }
-        return 0;
-    }
-
     // Macro storage and re-entrancy tracking
     std::unordered_map<std::string, std::shared_ptr<MacroDefinition>> macroTable;
     std::set<std::string> currentMacros;
@@ -271,16 +303,16 @@ public:
      expandMacro / processMacroParameters
      ------------------------------------
      Expand macro bodies by copying the macro AST and replacing parameter
-     tokens (\1, \2, ...) with the provided argument strings. The expansion
-     creates a shallow copy of the macro body AST and recursively replaces
-     parameter tokens within Token children.
+     tokens (\1, \2, ...) with the provided argument strings. The nodes of
+     the macro body are shared with its definition, so every node is copied
+     before its parameter tokens are replaced.
     */
     std::shared_ptr<ASTNode> expandMacro(
         const std::string& macroName,
         const std::vector<std::string>& args,
         const std::shared_ptr<ASTNode>& macroBody)
     {
-        auto expanded = std::make_shared<ASTNode>(*macroBody);
+        auto expanded = makeNode(*macroBody);
 
         for (auto& child : expanded->children) {
             if (auto stmt = std::get_if<std::shared_ptr<ASTNode>>(&child)) {
@@ -292,9 +324,10 @@ public:
     }
 
     void processMacroParameters(
-        std::shared_ptr<ASTNode> node,
+        std::shared_ptr<ASTNode>& node,
         const std::vector<std::string>& args)
     {
+        node = makeNode(*node);
         for (auto& child : node->children) {
 
             if (std::holds_alternative<std::shared_ptr<ASTNode>>(child)) {
@@ -302,20 +335,16 @@ public:
                 processMacroParameters(childnode, args);
             }
             else {
-                Token token = std::get<Token>(child);
+                Token& token = std::get<Token>(child);
                 if (token.value.size() > 1 && token.value[0] == '\\') {
-                    try {
-                        size_t paramNum = std::stoul(token.value.substr(1));
-                        if (paramNum > 0 && paramNum <= args.size()) {
-                            token.value = args[paramNum - 1];
-                        }
-                        else {
-                            throwError("Invalid macro parameter: " + token.value);
-                        }
-                    }
-                    catch (...) {
-                        throwError("Invalid macro parameter: " + token.value);
+                    // \N, N from 1 to the number of arguments
+                    size_t paramNum = 0;
+                    auto digits = token.value.substr(1);
+                    auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), paramNum);
+                    if (ec != std::errc() || paramNum == 0 || paramNum > args.size()) {
+                        throwError(DiagCode::Macro, "Invalid macro parameter: " + std::string(token.value));
                     }
+                    token.value = retainText(args[paramNum - 1]);
                 }
             }
         }
@@ -359,18 +388,27 @@ public:
     */
     std::string get_token_error_info() const
     {
-        const int range = 3;
+        return token_error_info(current_pos < tokens.size() ? tokens[current_pos] : Token());
+    }
 
-        if (current_pos >= tokens.size()) return "at end of input";
+    // Context of a token as get_token_error_info, "at end of input" for an
+    // INVALID token
+    std::string token_error_info(const Token& tok) const
+    {
+        const int range = 3;
 
-        const Token& tok = tokens[current_pos];
+        if (tok.type == INVALID) return "at end of input";
 
         std::string str = (tok.type != EOL ? ("at token type " + parserDict.at(tok.type)) +
-            " ('" + tok.value + "') " : " ") + "[line " +
-            tok.pos.filename + " " + std::to_string(tok.pos.line) + ", col " +
+            " ('" + std::string(tok.value) + "') " : " ") + "[line " +
+            tok.pos.filename() + " " + std::to_string(tok.pos.line) + ", col " +
             std::to_string(tok.line_pos) + "]";
 
-        auto lines = fileCache.at(tok.pos.filename);
+        // source lines only for files read through the cache
+        auto file = fileCache.find(tok.pos.filename());
+        if (file == fileCache.end())
+            return str + '\n';
+        auto& lines = file->second;
 
         for (auto l = std::max(tok.pos.line - range, static_cast<size_t>(0)); l < std::min(tok.pos.line + range, lines.size() - 1); ++l) {
             str += es.gr(es.BLUE_FOREGROUND);
@@ -382,7 +420,7 @@ public:
             else {
                 str += es.gr(es.WHITE_FOREGROUND);
             }
-            str += lines[l].second;
+            str += lines.line(l);
         }
         es.gr(es.RESET_ALL);
         str += '\n';
@@ -395,87 +433,194 @@ public:
     // Parse a specific grammar rule, return AST node (implementation in .cpp)
     std::shared_ptr<ASTNode> parse_rule(int64_t rule_type);
 
+    // Consume the current token if it has the given type, appending it to args
+    // (a terminal match as done by parse_rule, for actions that parse on)
+    bool match_token(TOKEN_TYPE type, std::vector<RuleArg>& args);
+
     // Pass initialization and main pass functions used by the assembler driver
     void InitPass();
     std::shared_ptr<ASTNode> Pass();
     std::shared_ptr<ASTNode> parse();
 
     /*
-        handle_binary_operation
-        -----------------------
-        Template helper that implements the common pattern of parsing left-associative
-        binary operations (e.g. expression parsing where left op right repeats).
-        - left: initial left operand (already parsed)
-        - allowed_ops: set of token types representing operators (+, -, etc.)
-        - rule_type: AST node type for the created binary node
-        - parse_right: callable that parses the right operand and returns AST node
-        - calculate: callable that computes node->value from left/right/op
-        - expected_name: name used in the error message if the right operand is missing
+        parse_data_line
+        ---------------
+        Fast path for a .byte / .word line whose items are all number literals
+        or strings: packs the values into a DataBytes node in one scan of the
+        tokens, without the grammar. The returned Line has the shape the
+        grammar builds (Line -> Statement -> Byte/WordDirective -> DataBytes)
+        and the same PC bookkeeping.
+        Returns nullptr (consuming nothing) for any other line, including a
+        label, an expression, a value out of range or a macro definition body;
+        parse_rule(Line) handles those.
     */
-    template<typename RuleFunc, typename CalcFunc>
-    std::shared_ptr<ASTNode> handle_binary_operation(
-        std::shared_ptr<ASTNode> left,
-        const std::set<TOKEN_TYPE>& allowed_ops,
-        int64_t rule_type,
-        RuleFunc parse_right,
-        CalcFunc calculate,
-        const std::string& expected_name)
-    {
-        while (current_pos < tokens.size() &&
-            allowed_ops.count(tokens[current_pos].type)) {
-            Token op = tokens[current_pos++];
-            auto right = parse_right();
-            if (!right) {
-                throwError(
-                    "Syntax error: expected " + expected_name +
-                    " after operator '" + op.value + "' " +
-                    get_token_error_info()
-                );
-            }
+    std::shared_ptr<ASTNode> parse_data_line();
+
+    // Line bookkeeping shared by the Line action and parse_data_line: add
+    // bytesInLine to PC and record the PC of the line in PCHistory
+    void end_line();
+
+    /*
+        Line replay
+        -----------
+        A pass parses the whole program again, but most lines parse to the
+        same nodes every pass. parse() records the top-level lines whose
+        result only depends on their tokens, the symbols they read and the
+        PC: instructions and .byte / .word, with or without a label. In the
+        next pass, a line at the same ordinal with the same tokens, whose
+        symbols all read the same values, reuses its nodes (replay_line):
+        the label is parsed again (it defines a symbol at PC), the node PCs
+        are moved and the bytes counted, the statement is not parsed.
+        Expression nodes keep only their values, so a line whose symbols
+        changed is parsed again.
+    */
+    struct SymbolRead {
+        Token token;                    // SYM / LOCALSYM reference
+        int value;                      // value read
+        bool found;                     // symbol was defined
+    };
+
+    // What the top-level line being parsed read (set by the grammar actions)
+    struct LineInputs {
+        bool tracing = false;           // record symbol reads (parse())
+        bool readsPC = false;           // result depends on PC (*, branch range)
+        bool replayable = true;         // false: depends on the pass number, or
+                                        // on an error the pass suppressed
+        std::vector<SymbolRead> symbols;
 
-            auto node = std::make_shared<ASTNode>(rule_type);
-            node->pc_Start = left->pc_Start;
-            node->add_child(left);
-            node->add_child(op);
-            node->add_child(right);
-            node->value = calculate(left->value, op.type, right->value);
-            left = node;
+        void clear()
+        {
+            readsPC = false;
+            replayable = true;
+            symbols.clear();
         }
-        return left;
-    }
+    };
+    LineInputs lineInputs;
+
+    // Lines answered by replay_line, for measuring
+    size_t linesReplayed = 0;
+
+    // Value of a symbol reference (SymbolRef); found is false for a symbol
+    // that is not defined (value 0)
+    int lookup_symbol(const Token& tok, bool& found);
+
+    /*
+        parse_operators
+        ---------------
+        Precedence climbing over the binary operators of an expression.
+        - left: value of the operand already parsed (a Factor)
+        - min_power: lowest binding power consumed (1 = every operator)
+        Operands are parsed with parse_rule(Factor); returns the value of
+        `left op Factor op Factor ...` with the usual C precedence, all levels
+        left associative. Throws if an operator is not followed by an operand.
+    */
+    int32_t parse_operators(int32_t left, int min_power);
+
+    // Times each rule matched ending at each token position; the count passed
+    // to grammar actions (0 = first match, apply side effects)
+    RuleMatches ruleMatches;
+
+private:
+    // Result of a pure rule parse at a token position.
+    struct MemoEntry {
+        std::shared_ptr<ASTNode> node;  // nullptr if the rule did not match
+        size_t end;                     // current_pos after the parse
+        SourcePos sourcePos;            // sourcePos after the parse
+        uint32_t stamp = 0;             // entry is valid while stamp == memoStamp
+        bool setsSourcePos;             // the parse matched at least one terminal
+    };
+
+    // Flat table indexed by (token position - memoBase) * pure rule count + slot
+    // of the rule. Entries are dropped by bumping memoStamp, so invalidating
+    // costs nothing however often the state changes.
+    std::vector<MemoEntry> memo;
+    uint32_t memoStamp = 1;
+    size_t memoBase = 0;
+    bool memoUsed = false;
+
+    MemoEntry* memoEntry(size_t pos, int slot, bool grow);
+
+    // parse_rule nesting depth; the memo only lives for one outermost call
+    int ruleDepth = 0;
 
-    // Track which rules have been processed for a given token position to avoid infinite recursion
-    static std::map<std::pair<size_t, int64_t>, int> rule_processed;
+    // Terminals matched so far (tells whether a parse set sourcePos)
+    size_t terminalsMatched = 0;
+
+    // One token stream edit, with what is needed to undo it.
+    struct TokenEdit {
+        size_t at;                      // index of the edit
+        size_t inserted;                // tokens inserted at `at`
+        TokenStore removed;             // tokens erased at `at`
+    };
+
+    // Undo journal of token edits, recorded once a ParseState has been taken
+    // in this pass (getCurrentState); cleared by InitPass.
+    std::vector<TokenEdit> tokenEdits;
+    bool journaling = false;
+
+    // States saved by pushParseState
+    std::stack<ParseState> parseStack;
+
+    // A top-level line recorded for replay_line.
+    struct ReplayLine {
+        std::vector<Token> tokens;      // the line up to its EOL (empty: none)
+        std::vector<SymbolRead> symbols;
+        bool readsPC = false;
+        int32_t pc = 0;                 // PC of the line, the pc_Start of its nodes
+        int32_t bytes = 0;              // bytes the line adds to PC
+        size_t labelTokens = 0;         // tokens of a leading label
+        std::shared_ptr<ASTNode> statement; // nullptr for a label or comment line
+        std::shared_ptr<ASTNode> eol;
+    };
+
+    // Recorded lines by top-level line ordinal
+    std::vector<ReplayLine> replayLines;
+
+    // The recorded line at ordinal if it still applies at current_pos
+    // (nullptr, nothing consumed, otherwise)
+    std::shared_ptr<ASTNode> replay_line(size_t ordinal);
+
+    // Record the line parsed from start (PC startPC) if it can be replayed
+    void record_line(size_t ordinal, size_t start, int32_t startPC, const std::shared_ptr<ASTNode>& line);
+
+    // The top-level line at current_pos (replayed or parsed), nullptr at the
+    // end of the tokens
+    std::shared_ptr<ASTNode> parse_line(size_t ordinal);
+
+    // Record the error of the line starting at start and skip past its EOL;
+    // false once maxErrors errors were recorded or no line follows
+    bool recover(const std::exception& error, size_t start);
+
+    // Journal an erase of [first, last) before it is made, and an insert of
+    // count tokens at `at` after it is made.
+    void recordErase(size_t first, size_t last);
+    void recordInsert(size_t at, size_t count);
+
+public:
 
     /*
      findLineStart / findLineEnd
      ---------------------------
      Utility functions to locate the token index that marks the beginning or
      end (EOL token) of the logical source line that contains a given token index.
-     Useful when splicing token ranges by line.
+     Useful when splicing token ranges by line. Both are lookups in the EOL
+     index of the token store.
     */
-    static size_t findLineStart(const std::vector<Token>& tokens, size_t idx)
+    static size_t findLineStart(const TokenStore& tokens, size_t idx)
     {
         // Move to the token just before idx if idx points at EOL or end
-        if (idx > 0 && idx <= tokens.size() && idx < tokens.size() && tokens[idx].type == EOL) {
-            --idx;
-        }
-        while (idx > 0 && tokens[idx - 1].type != EOL) {
+        if (idx > 0 && idx < tokens.size() && tokens.type(idx) == EOL) {
             --idx;
         }
-        return idx;
+        size_t prev = tokens.prevEOL(std::min(idx, tokens.size()));
+        return prev == TokenStore::npos ? 0 : prev + 1;
     }
 
-    static size_t findLineEnd(const std::vector<Token>& tokens, size_t idx)
+    static size_t findLineEnd(const TokenStore& tokens, size_t idx)
     {
-        // Move forward to (just after) the EOL that terminates this line
-        while (idx < tokens.size() && tokens[idx].type != EOL) {
-            ++idx;
-        }
-        if (idx < tokens.size()) {
-            ++idx; // include the EOL
-        }
-        return idx;
+        // Just after the EOL that terminates this line
+        size_t eol = tokens.nextEOL(idx);
+        return eol == TokenStore::npos ? tokens.size() : eol + 1;
     }
 
     // Finds the index of the previous EOL before idx. Returns (size_t)-1 if none.
@@ -492,12 +637,19 @@ public:
         size_t endifIdx;
     };
 
-    ElseEndif FindMatchingElseEndif(size_t from) const;
+    // Index of the .if/.ifdef/.ifndef on the directive line ending after afterDirectivePos. Throws if none.
+    size_t FindConditionalOpener(size_t afterDirectivePos) const;
+
+    // Matching .else (if any) and .endif of the conditional directive at opener. Throws if unmatched.
+    ElseEndif FindMatchingElseEndif(size_t opener) const;
     
 
     // Delete inactive/structural parts of a parsed conditional starting immediately after the directive
     void SpliceConditional(bool cond, size_t afterDirectivePos);
 
+    // Remove the .else/.endif line at current_pos of a conditional already spliced
+    void DropConditionalCloser();
+
     // Query symbol existence across local/global/var symbol tables
     bool IsSymbolDefined(const std::string& name) const
     {
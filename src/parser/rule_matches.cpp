@@ -0,0 +1,51 @@
+// written by Paul Baxter
+// rule_matches.cpp
+#include <algorithm>
+
+#include "expr_rules.h"
+#include "rule_matches.h"
+
+static_assert(Factor > 0 && Prog < 0x10000, "rule ids must fit the 16 bit key field");
+
+// Initial number of slots (power of two)
+static constexpr size_t INITIAL_SLOTS = 1024;
+
+/// <summary>
+/// Forget every match. The table keeps its size, a pass records about as
+/// many matches as the one before it.
+/// </summary>
+void RuleMatches::clear()
+{
+    if (used == 0) return;
+    std::fill(keys.begin(), keys.end(), EMPTY);
+    std::fill(counts.begin(), counts.end(), 0);
+    used = 0;
+}
+
+/// <summary>
+/// Double the table (or allocate the first one) and reinsert every entry.
+/// </summary>
+void RuleMatches::grow()
+{
+    std::vector<uint64_t> oldKeys = std::move(keys);
+    std::vector<int> oldCounts = std::move(counts);
+
+    size_t slots = oldKeys.empty() ? INITIAL_SLOTS : oldKeys.size() * 2;
+    keys.assign(slots, EMPTY);
+    counts.assign(slots, 0);
+    mask = slots - 1;
+    shift = 64;
+    for (size_t n = slots; n > 1; n >>= 1) {
+        --shift;
+    }
+
+    for (size_t j = 0; j < oldKeys.size(); ++j) {
+        if (oldKeys[j] == EMPTY) continue;
+        size_t i = home(oldKeys[j]);
+        while (keys[i] != EMPTY) {
+            i = (i + 1) & mask;
+        }
+        keys[i] = oldKeys[j];
+        counts[i] = oldCounts[j];
+    }
+}
@@ -0,0 +1,76 @@
+// written by Paul Baxter
+// rule_matches.h
+//
+// Times each rule matched ending at each token position, per Parser.
+//
+//  - Grammar actions receive this count: 0 the first time a rule matches at
+//    a position, so side effects (PC, symbols, bytes) happen once even when
+//    backtracking parses the same tokens again.
+//  - Stored in a flat open addressing table keyed by (position << 16 | rule),
+//    so a lookup is a multiply and a short linear probe.
+//  - Cleared at the start of every pass (Parser::InitPass, reset_rules).
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class RuleMatches {
+public:
+    // Times rule matched ending at token position pos (0 if it never did).
+    int count(size_t pos, int64_t rule) const
+    {
+        if (keys.empty()) return 0;
+        uint64_t k = key(pos, rule);
+        for (size_t i = home(k); ; i = (i + 1) & mask) {
+            if (keys[i] == k) return counts[i];
+            if (keys[i] == EMPTY) return 0;
+        }
+    }
+
+    // Record one more match of rule ending at token position pos.
+    void record(size_t pos, int64_t rule)
+    {
+        if ((used + 1) * 2 > keys.size()) grow();
+        uint64_t k = key(pos, rule);
+        size_t i = home(k);
+        while (keys[i] != k && keys[i] != EMPTY) {
+            i = (i + 1) & mask;
+        }
+        if (keys[i] == EMPTY) {
+            keys[i] = k;
+            ++used;
+        }
+        ++counts[i];
+    }
+
+    // Forget every match (keeps the allocated table).
+    void clear();
+
+    // Number of (position, rule) pairs recorded.
+    size_t size() const { return used; }
+
+private:
+    static constexpr uint64_t EMPTY = 0;
+
+    // Rule ids are nonzero and below 1 << 16 (checked in rule_matches.cpp),
+    // so a key is never EMPTY.
+    static uint64_t key(size_t pos, int64_t rule)
+    {
+        assert(rule > 0 && rule < 0x10000);
+        return (static_cast<uint64_t>(pos) << 16) | static_cast<uint64_t>(rule);
+    }
+
+    size_t home(uint64_t k) const
+    {
+        return static_cast<size_t>((k * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    void grow();
+
+    std::vector<uint64_t> keys;     // EMPTY or key(pos, rule)
+    std::vector<int> counts;
+    size_t used = 0;
+    size_t mask = 0;                // keys.size() - 1
+    unsigned shift = 64;            // 64 - log2(keys.size())
+};
@@ -0,0 +1,208 @@
+// written by Paul Baxter
+// source_buffer.cpp
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define __NO_MMAP__
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "common_types.h"
+#include "source_buffer.h"
+
+//=============================================================================
+// Retained buffers
+//=============================================================================
+
+/// <summary>
+/// Buffers and file mappings kept alive for the rest of the run.
+/// </summary>
+struct RetainedBuffers {
+    std::mutex lock;
+    std::vector<SourceBuffer> buffers;
+    std::unordered_map<std::string_view, SourceBuffer> texts;   // retainText, keyed by the text
+    std::vector<std::string_view> mappings;
+    size_t bytes = 0;
+
+    ~RetainedBuffers()
+    {
+#ifndef __NO_MMAP__
+        for (auto& m : mappings) {
+            munmap(const_cast<char*>(m.data()), m.size());
+        }
+#endif
+    }
+};
+
+static RetainedBuffers& retained()
+{
+    static RetainedBuffers instance;
+    return instance;
+}
+
+/// <summary>
+/// Create a buffer holding the text.
+/// </summary>
+SourceBuffer makeSourceBuffer(std::string text)
+{
+    return std::make_shared<const std::string>(std::move(text));
+}
+
+/// <summary>
+/// Keep the buffer alive for the rest of the run.
+/// </summary>
+/// <returns>A view of the buffer text.</returns>
+std::string_view retainBuffer(const SourceBuffer& buffer)
+{
+    auto& r = retained();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.buffers.push_back(buffer);
+    r.bytes += buffer->size();
+    return *buffer;
+}
+
+/// <summary>
+/// Copy text into a retained buffer. Identical text shares one buffer, so a
+/// macro expansion, .fill or loop body tokenized again in every pass or
+/// iteration is kept once.
+/// </summary>
+/// <returns>A view of the retained copy.</returns>
+std::string_view retainText(std::string text)
+{
+    auto& r = retained();
+    std::lock_guard<std::mutex> guard(r.lock);
+    auto it = r.texts.find(text);
+    if (it != r.texts.end())
+        return *it->second;
+
+    auto buffer = makeSourceBuffer(std::move(text));
+    r.texts.emplace(*buffer, buffer);
+    r.bytes += buffer->size();
+    return *buffer;
+}
+
+/// <summary>
+/// Map a file read-only for the rest of the run.
+/// </summary>
+/// <param name="path">File to map.</param>
+/// <returns>A view of the file contents, empty if it cannot be read.</returns>
+std::string_view retainMappedFile(const std::string& path)
+{
+#ifdef __NO_MMAP__
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return {};
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (text.empty())
+        return {};
+    return retainText(std::move(text));
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return {};
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED)
+        return {};
+
+    std::string_view view(static_cast<const char*>(data), static_cast<size_t>(st.st_size));
+    auto& r = retained();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.mappings.push_back(view);
+    r.bytes += view.size();
+    return view;
+#endif
+}
+
+/// <summary>
+/// Retain the text of a source file so every line, the last included, is
+/// followed by '\n'. Files that already end with a line feed are mapped.
+/// </summary>
+std::string_view retainSourceFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return {};
+    auto size = static_cast<std::streamoff>(file.tellg());
+    if (size <= 0)
+        return {};
+
+    char last = 0;
+    file.seekg(size - 1);
+    file.get(last);
+    if (last == '\n')
+        return retainMappedFile(path);
+
+    std::string text(static_cast<size_t>(size), '\0');
+    file.seekg(0);
+    file.read(text.data(), size);
+    text.resize(static_cast<size_t>(file.gcount()));
+    text += '\n';
+    return retainText(std::move(text));
+}
+
+size_t retainedBufferBytes()
+{
+    auto& r = retained();
+    std::lock_guard<std::mutex> guard(r.lock);
+    return r.bytes;
+}
+
+//=============================================================================
+// Filename table
+//=============================================================================
+
+/// <summary>
+/// Interned filenames. A deque keeps references stable while it grows.
+/// </summary>
+struct FilenameTable {
+    std::mutex lock;
+    std::deque<std::string> names{ "" };
+    std::unordered_map<std::string, uint32_t> ids{ { "", 0 } };
+};
+
+static FilenameTable& filenames()
+{
+    static FilenameTable instance;
+    return instance;
+}
+
+/// <summary>
+/// Return the id for a filename, adding it on first use.
+/// </summary>
+uint32_t internFilename(const std::string& filename)
+{
+    auto& t = filenames();
+    std::lock_guard<std::mutex> guard(t.lock);
+    auto it = t.ids.find(filename);
+    if (it != t.ids.end())
+        return it->second;
+
+    auto id = static_cast<uint32_t>(t.names.size());
+    t.names.push_back(filename);
+    t.ids.emplace(filename, id);
+    return id;
+}
+
+/// <summary>
+/// Return the filename for an id.
+/// </summary>
+const std::string& filenameOf(uint32_t file)
+{
+    auto& t = filenames();
+    std::lock_guard<std::mutex> guard(t.lock);
+    return t.names[file];
+}
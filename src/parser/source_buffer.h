@@ -0,0 +1,49 @@
+// written by Paul Baxter
+// source_buffer.h
+//
+// Immutable text buffers that token values point into, retained for the
+// whole run (nothing is released before exit).
+//
+//  - Every tokenized unit (a source file, a macro expansion, a loop body, ...)
+//    is lexed out of its own SourceBuffer and Token::value is a
+//    std::string_view into that buffer, so copying tokens never allocates.
+//  - Tokens are copied freely (token vectors, parse states, AST leaves), so a
+//    buffer handed to retainBuffer() stays alive for the rest of the run.
+//    Other owners share the same buffer through the shared_ptr.
+//  - Generated text (retainText) is kept once per distinct text, so the
+//    retained memory is bounded by the distinct expansions of a run, not by
+//    how often they are tokenized.
+//  - Files can also be memory mapped and retained the same way (source files
+//    read by the Parser and on-disk token cache entries).
+//  - The filename table used by SourcePos (internFilename / filenameOf in
+//    common_types.h) is implemented alongside.
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+
+using SourceBuffer = std::shared_ptr<const std::string>;
+
+// Create a buffer holding `text`.
+SourceBuffer makeSourceBuffer(std::string text);
+
+// Keep `buffer` alive for the rest of the run and return a view of its text.
+std::string_view retainBuffer(const SourceBuffer& buffer);
+
+// Copy `text` into a retained buffer and return a view of it. Identical text
+// shares one buffer, so text rebuilt and tokenized again (macro expansions,
+// .fill, loop bodies in every pass or iteration) does not grow memory.
+std::string_view retainText(std::string text);
+
+// Map a file read-only and keep the mapping for the rest of the run.
+// Returns an empty view if the file cannot be opened or is empty. Where
+// memory mapping is not available the file is read into a retained buffer.
+std::string_view retainMappedFile(const std::string& path);
+
+// Retain the text of a source file for SourceText: mapped when it is empty or
+// ends with '\n', otherwise read into a retained buffer with '\n' appended.
+// Returns an empty view if the file cannot be read or is empty.
+std::string_view retainSourceFile(const std::string& path);
+
+// Total bytes held by retained buffers and mappings (diagnostics).
+size_t retainedBufferBytes();
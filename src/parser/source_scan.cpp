@@ -0,0 +1,307 @@
+// written by Paul Baxter
+// source_scan.cpp
+//
+// SIMD byte classification for source ingestion. See source_scan.h.
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#include "source_scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define __SOURCE_SCAN_X86__
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SCAN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SCAN_TARGET(isa)
+#endif
+
+//=============================================================================
+// Block classifiers
+//=============================================================================
+
+/// <summary>
+/// Bit masks for one 64 byte block; bit i describes byte i of the block.
+/// </summary>
+struct BlockMasks {
+    uint64_t newline;
+    uint64_t semi;
+    uint64_t quote;
+    uint64_t blank;
+};
+
+using BlockScanner = void (*)(const char* p, BlockMasks& m);
+
+static constexpr size_t BLOCK = 64;
+
+/// <summary>
+/// Portable classifier.
+/// </summary>
+static void scanBlockScalar(const char* p, BlockMasks& m)
+{
+    m = {};
+    for (size_t i = 0; i < BLOCK; ++i) {
+        uint64_t bit = uint64_t(1) << i;
+        switch (p[i]) {
+            case '\n': m.newline |= bit; break;
+            case ';': m.semi |= bit; break;
+            case '\'':
+            case '"': m.quote |= bit; break;
+            case ' ':
+            case '\t': m.blank |= bit; break;
+            default: break;
+        }
+    }
+}
+
+#ifdef __SOURCE_SCAN_X86__
+/// <summary>
+/// SSE2 classifier: four 16 byte compares per class.
+/// </summary>
+SCAN_TARGET("sse2")
+static void scanBlockSSE2(const char* p, BlockMasks& m)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i semi = _mm_set1_epi8(';');
+    const __m128i squote = _mm_set1_epi8('\'');
+    const __m128i dquote = _mm_set1_epi8('"');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+
+    m = {};
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * 16));
+        // the compares stay in this function: a lambda would not get its target
+        uint32_t newline = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+        uint32_t semicolon = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, semi)));
+        uint32_t quote = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, squote), _mm_cmpeq_epi8(v, dquote))));
+        uint32_t blank = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab))));
+        int shift = i * 16;
+        m.newline |= static_cast<uint64_t>(newline) << shift;
+        m.semi |= static_cast<uint64_t>(semicolon) << shift;
+        m.quote |= static_cast<uint64_t>(quote) << shift;
+        m.blank |= static_cast<uint64_t>(blank) << shift;
+    }
+}
+
+/// <summary>
+/// AVX2 classifier: two 32 byte compares per class.
+/// </summary>
+SCAN_TARGET("avx2")
+static void scanBlockAVX2(const char* p, BlockMasks& m)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i semi = _mm256_set1_epi8(';');
+    const __m256i squote = _mm256_set1_epi8('\'');
+    const __m256i dquote = _mm256_set1_epi8('"');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+
+    m = {};
+    for (int i = 0; i < 2; ++i) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i * 32));
+        // the compares stay in this function: a lambda would not get its target
+        uint32_t newline = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+        uint32_t semicolon = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, semi)));
+        uint32_t quote = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, squote), _mm256_cmpeq_epi8(v, dquote))));
+        uint32_t blank = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab))));
+        int shift = i * 32;
+        m.newline |= static_cast<uint64_t>(newline) << shift;
+        m.semi |= static_cast<uint64_t>(semicolon) << shift;
+        m.quote |= static_cast<uint64_t>(quote) << shift;
+        m.blank |= static_cast<uint64_t>(blank) << shift;
+    }
+}
+#endif
+
+//=============================================================================
+// Runtime selection
+//=============================================================================
+
+/// <summary>
+/// Best level supported by the CPU running the assembler.
+/// </summary>
+static ScanLevel detectScanLevel()
+{
+#ifdef __SOURCE_SCAN_X86__
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ScanLevel::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return ScanLevel::SSE2;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5))
+            return ScanLevel::AVX2;
+    }
+    if (sse2)
+        return ScanLevel::SSE2;
+#endif
+#endif
+    return ScanLevel::Scalar;
+}
+
+static const ScanLevel supportedLevel = detectScanLevel();
+static ScanLevel activeLevel = supportedLevel;
+
+/// <summary>
+/// Block classifier for the active level.
+/// </summary>
+static BlockScanner blockScanner()
+{
+#ifdef __SOURCE_SCAN_X86__
+    switch (activeLevel) {
+        case ScanLevel::AVX2: return scanBlockAVX2;
+        case ScanLevel::SSE2: return scanBlockSSE2;
+        default: break;
+    }
+#endif
+    return scanBlockScalar;
+}
+
+ScanLevel sourceScanLevel()
+{
+    return activeLevel;
+}
+
+ScanLevel setSourceScanLevel(ScanLevel level)
+{
+    activeLevel = static_cast<int>(level) <= static_cast<int>(supportedLevel) ? level : supportedLevel;
+    return activeLevel;
+}
+
+const char* scanLevelName(ScanLevel level)
+{
+    switch (level) {
+        case ScanLevel::AVX2: return "AVX2";
+        case ScanLevel::SSE2: return "SSE2";
+        default: return "scalar";
+    }
+}
+
+//=============================================================================
+// Line reduction
+//=============================================================================
+
+/// <summary>
+/// Classifies text block by block and reduces the masks to SourceLine records.
+/// </summary>
+/// <param name="text">Text to scan.</param>
+/// <param name="split">When true '\n' ends a line; otherwise the whole text is one line.</param>
+/// <param name="sink">Called with each line in order.</param>
+template <typename Sink>
+static void scanText(std::string_view text, bool split, Sink&& sink)
+{
+    const auto scanBlock = blockScanner();
+    const size_t n = text.size();
+
+    size_t start = 0;
+    size_t firstNonBlank = SourceLine::npos;
+    size_t firstSemi = SourceLine::npos;
+    size_t firstQuote = SourceLine::npos;
+    bool embeddedNewline = false;
+
+    auto emit = [&](size_t end)
+        {
+            SourceLine line;
+            line.offset = start;
+            line.length = end - start;
+            line.indent = (firstNonBlank == SourceLine::npos ? end : firstNonBlank) - start;
+            if (firstSemi != SourceLine::npos && !embeddedNewline &&
+                (firstQuote == SourceLine::npos || firstQuote > firstSemi)) {
+                line.comment = firstSemi - start;
+            }
+            sink(line);
+            firstNonBlank = firstSemi = firstQuote = SourceLine::npos;
+        };
+
+    for (size_t base = 0; base < n; base += BLOCK) {
+        BlockMasks m;
+        uint64_t valid = ~uint64_t(0);
+        if (n - base >= BLOCK) {
+            scanBlock(text.data() + base, m);
+        }
+        else {
+            char tail[BLOCK] = {};
+            std::memcpy(tail, text.data() + base, n - base);
+            scanBlock(tail, m);
+            valid = (uint64_t(1) << (n - base)) - 1;
+        }
+
+        uint64_t newline = m.newline & valid;
+        uint64_t semi = m.semi & valid;
+        uint64_t quote = m.quote & valid;
+        uint64_t nonBlank = ~m.blank & valid;
+
+        if (!split) {
+            embeddedNewline |= newline != 0;
+            newline = 0;
+        }
+
+        for (;;) {
+            // bits of the current line in this block
+            uint64_t upto = newline ? (newline & (~newline + 1)) - 1 : ~uint64_t(0);
+            if (firstNonBlank == SourceLine::npos && (nonBlank & upto))
+                firstNonBlank = base + std::countr_zero(nonBlank & upto);
+            if (firstSemi == SourceLine::npos && (semi & upto))
+                firstSemi = base + std::countr_zero(semi & upto);
+            if (firstQuote == SourceLine::npos && (quote & upto))
+                firstQuote = base + std::countr_zero(quote & upto);
+            if (!newline)
+                break;
+
+            size_t end = base + std::countr_zero(newline);
+            emit(end);
+            start = end + 1;
+
+            uint64_t keep = ~((upto << 1) | 1);
+            newline &= keep;
+            semi &= keep;
+            quote &= keep;
+            nonBlank &= keep;
+        }
+    }
+
+    if (!split || start < n)
+        emit(n);
+}
+
+/// <summary>
+/// Split text into lines with std::getline semantics.
+/// </summary>
+/// <param name="text">Whole file contents.</param>
+/// <returns>One record per line.</returns>
+std::vector<SourceLine> scanSource(std::string_view text)
+{
+    std::vector<SourceLine> lines;
+    lines.reserve(text.size() / 32 + 1);
+    scanText(text, true, [&lines](const SourceLine& line) { lines.push_back(line); });
+    return lines;
+}
+
+/// <summary>
+/// Summarize a single line.
+/// </summary>
+/// <param name="line">Line text without the terminating '\n'.</param>
+/// <returns>The line record (offset 0).</returns>
+SourceLine scanLine(std::string_view line)
+{
+    SourceLine result;
+    scanText(line, false, [&result](const SourceLine& l) { result = l; });
+    return result;
+}
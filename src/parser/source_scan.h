@@ -0,0 +1,62 @@
+// written by Paul Baxter
+// source_scan.h
+//
+// Front end byte scanner used when reading source files and before lexing.
+// Source text is classified 64 bytes at a time into bit masks for line feeds,
+// comment starts (';'), quotes (' and ") and blanks (space / tab). The masks
+// are produced with AVX2 or SSE2 compares when the CPU supports them and by a
+// portable scalar loop otherwise; the level is chosen once at runtime.
+//
+// The masks are reduced to one SourceLine record per line, so the tokenizer
+// can skip leading blanks and jump straight over a trailing comment:
+//  - scanSource() splits a whole text into lines (std::getline semantics).
+//    The tokenizer scans the text of a run of SourceText lines once.
+//  - scanLine() summarizes a single line (a line tokenized on its own).
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Summary of one source line.
+struct SourceLine {
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Offset of the first character of the line in the scanned text.
+    size_t offset = 0;
+
+    // Length of the line, not counting the terminating '\n'.
+    size_t length = 0;
+
+    // Number of leading blanks (space / tab).
+    size_t indent = 0;
+
+    // Offset within the line of a ';' that starts the comment, or npos.
+    // Only set when no quote precedes it, so it cannot be inside a
+    // character constant or text.
+    size_t comment = npos;
+};
+
+// Instruction set used by the scanner.
+enum class ScanLevel {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// Level selected for this CPU (best supported).
+ScanLevel sourceScanLevel();
+
+// Force a scan level (tests / benchmarking). Levels the CPU does not support
+// fall back to the best supported one. Returns the level in effect.
+ScanLevel setSourceScanLevel(ScanLevel level);
+
+// Split text into lines like repeated std::getline: each '\n' ends a line and
+// a final line without '\n' is kept when it is not empty.
+std::vector<SourceLine> scanSource(std::string_view text);
+
+// Summarize a single line (no line splitting; a '\n' inside the line disables the comment hint).
+SourceLine scanLine(std::string_view line);
+
+// Name of a scan level for diagnostics.
+const char* scanLevelName(ScanLevel level);
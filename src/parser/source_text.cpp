@@ -0,0 +1,82 @@
+// written by Paul Baxter
+// source_text.cpp
+//
+// Source lines with a line offset index. See source_text.h.
+#include <cstring>
+#include <stdexcept>
+
+#include "source_buffer.h"
+#include "source_text.h"
+
+/// <summary>
+/// Index the lines of a file held in a retained buffer.
+/// Lines are split like repeated std::getline.
+/// </summary>
+/// <param name="filename">File the lines belong to.</param>
+/// <param name="text">Retained file text, empty or ending with '\n'.</param>
+/// <exception cref="std::runtime_error">Thrown if the file is 4GB or larger.</exception>
+SourceText::SourceText(const std::string& filename, std::string_view text) : buffer(text), file(internFilename(filename))
+{
+    if (text.size() >= UINT32_MAX)
+        throw std::runtime_error("File too large: " + filename);
+
+    const char* s = text.data();
+    size_t offset = 0;
+    while (offset < text.size()) {
+        offsets.push_back(static_cast<uint32_t>(offset));
+        auto nl = static_cast<const char*>(std::memchr(s + offset, '\n', text.size() - offset));
+        offset = nl ? static_cast<size_t>(nl - s) + 1 : text.size();
+    }
+    offsets.push_back(static_cast<uint32_t>(text.size()));
+}
+
+/// <summary>
+/// Join lines into a new retained buffer, keeping the position of each line.
+/// </summary>
+/// <param name="lines">Source lines.</param>
+SourceText::SourceText(const std::vector<std::pair<SourcePos, std::string>>& lines)
+{
+    size_t size = 0;
+    for (const auto& [pos, str] : lines) {
+        size += str.size() + 1;
+    }
+    if (size >= UINT32_MAX)
+        throw std::runtime_error("Source text too large");
+
+    std::string text;
+    text.reserve(size);
+    offsets.reserve(lines.size() + 1);
+    positions.reserve(lines.size());
+    for (const auto& [pos, str] : lines) {
+        offsets.push_back(static_cast<uint32_t>(text.size()));
+        positions.push_back(pos);
+        text += str;
+        text += '\n';
+    }
+    offsets.push_back(static_cast<uint32_t>(text.size()));
+    buffer = retainText(std::move(text));
+}
+
+SourcePos SourceText::pos(size_t i) const
+{
+    if (!positions.empty())
+        return positions[i];
+
+    SourcePos pos;
+    pos.file = file;
+    pos.line = i + 1;
+    return pos;
+}
+
+/// <summary>
+/// Copy of the lines as (position, text) pairs.
+/// </summary>
+std::vector<std::pair<SourcePos, std::string>> SourceText::lines() const
+{
+    std::vector<std::pair<SourcePos, std::string>> result;
+    result.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+        result.emplace_back(pos(i), std::string(line(i)));
+    }
+    return result;
+}
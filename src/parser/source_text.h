@@ -0,0 +1,63 @@
+// written by Paul Baxter
+// source_text.h
+//
+// Source lines held in one retained buffer plus a line offset index.
+//
+//  - Source files are memory mapped (retainSourceFile in source_buffer.h) and
+//    indexed once; a line is a view into the mapping, so reading a file costs
+//    about its size plus 4 bytes per line and cached reads copy nothing.
+//  - The buffer holds every line followed by '\n' (the layout the Tokenizer
+//    lexes from), so the whole text can be handed to the Tokenizer and the
+//    token cache without joining lines.
+//  - Lines of a file get the positions (file, 1), (file, 2), ... . Text built
+//    from (SourcePos, line) pairs (macro and loop bodies) is joined into a new
+//    retained buffer and keeps the position of each line.
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common_types.h"
+
+class SourceText {
+public:
+    SourceText() = default;
+
+    // Lines of a file. `text` must be retained and empty or end with '\n'.
+    SourceText(const std::string& filename, std::string_view text);
+
+    // Arbitrary lines, joined into a new retained buffer.
+    explicit SourceText(const std::vector<std::pair<SourcePos, std::string>>& lines);
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+
+    // Line i (0 based) without its '\n'.
+    std::string_view line(size_t i) const { return buffer.substr(offsets[i], offsets[i + 1] - offsets[i] - 1); }
+
+    // Offset of line i in text().
+    size_t offset(size_t i) const { return offsets[i]; }
+
+    // Source position of line i.
+    SourcePos pos(size_t i) const;
+
+    // All lines, each followed by '\n'.
+    std::string_view text() const { return buffer; }
+
+    // Copy of the lines as (position, text) pairs.
+    std::vector<std::pair<SourcePos, std::string>> lines() const;
+
+private:
+    std::string_view buffer;
+
+    // Start of each line plus the end of the text.
+    std::vector<uint32_t> offsets;
+
+    // File id of a file's lines.
+    uint32_t file = 0;
+
+    // Per line positions when the lines do not come from one file.
+    std::vector<SourcePos> positions;
+};
@@ -31,13 +31,13 @@ public:
 
         for (const auto& [historyPos, historyValue] : history) {
             // Reset iteration counter when we move to a new position
-            if (historyPos.filename != lastPos.filename || historyPos.line != lastPos.line) {
+            if (historyPos.file != lastPos.file || historyPos.line != lastPos.line) {
                 currentIteration = 0;
                 lastPos = historyPos;
             }
 
             // If we've reached or passed the target position, check iteration
-            if (historyPos.filename == pos.filename && historyPos.line >= pos.line) {
+            if (historyPos.file == pos.file && historyPos.line >= pos.line) {
                 // If this is the exact position and iteration we're looking for, return previous value
                 if (historyPos.line == pos.line && currentIteration == iteration) {
                     return val;  // Return value BEFORE this change
@@ -63,7 +63,7 @@ public:
 
     void print()
     {
-        std::string createdstr = created.filename.empty() ? "" : created.filename + " " + std::to_string(created.line);
+        std::string createdstr = created.filename().empty() ? "" : created.filename() + " " + std::to_string(created.line);
 
         std::cout <<
             "\nname:        " << name <<
@@ -78,14 +78,14 @@ public:
             "\naccessed:    \n";
 #ifdef __SHOW_SYM_ACCESS__
         for (auto& access : accessed) {
-            std::cout << "[" << access.filename << " line " << access.line << "]\n";
+            std::cout << "[" << access.filename() << " line " << access.line << "]\n";
         }
 #endif
         std::cout << "\nHistory\n";
         for (auto& entry : history) {
             auto& pos = entry.first;
             auto& val = entry.second;
-            std::cout << "[" << pos.filename << " line " << std::dec << pos.line << "] $" << std::setfill('0') << std::setw(4) << std::hex << val << "\n";
+            std::cout << "[" << pos.filename() << " line " << std::dec << pos.line << "] $" << std::setfill('0') << std::setw(4) << std::hex << val << "\n";
         }
 
         std::cout << "\n";
@@ -14,9 +14,9 @@ void SymTable::add(std::string& name, SourcePos pos)
 {
     auto uppername = toupper(name);
     if (symtable.contains(uppername)) {
-        if (!symtable[uppername].created.filename.empty() && symtable[uppername].created != pos) {
+        if (!symtable[uppername].created.filename().empty() && symtable[uppername].created != pos) {
             throw std::runtime_error(
-                "Multiple defined symbol " + name + " " + pos.filename + " " + std::to_string(pos.line)
+                "Multiple defined symbol " + name + " " + pos.filename() + " " + std::to_string(pos.line)
             );
         }
         return;
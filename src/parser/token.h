@@ -2,35 +2,58 @@
 // Token.h
 #pragma once
 #include <string>
+#include <string_view>
 #include <common_types.h>
 
+// Mnemonics in TOKEN_TYPE order. This list is the single source of truth for the
+// opcode token values, the scanner keyword table (keywords.h), the regex fallback
+// patterns and the parserDict names. M(name) is expanded once per mnemonic.
+#define TOKEN_MNEMONICS(M) \
+    M(ORA) M(AND) M(EOR) M(ADC) M(SBC) \
+    M(CMP) M(CPX) M(CPY) M(DEC) M(DEX) \
+    M(DEY) M(INC) M(INX) M(INY) M(ASL) \
+    M(ROL) M(LSR) M(ROR) M(LDA) M(STA) \
+    M(LDX) M(STX) M(LDY) M(STY) M(RMB0) \
+    M(RMB1) M(RMB2) M(RMB3) M(RMB4) M(RMB5) \
+    M(RMB6) M(RMB7) M(SMB0) M(SMB1) M(SMB2) \
+    M(SMB3) M(SMB4) M(SMB5) M(SMB6) M(SMB7) \
+    M(STZ) M(TAX) M(TXA) M(TAY) M(TYA) \
+    M(TSX) M(TXS) M(PLA) M(PHA) M(PLP) \
+    M(PHP) M(PHX) M(PHY) M(PLX) M(PLY) \
+    M(BRA) M(BPL) M(BMI) M(BVC) M(BVS) \
+    M(BCC) M(BCS) M(BNE) M(BEQ) M(BBR0) \
+    M(BBR1) M(BBR2) M(BBR3) M(BBR4) M(BBR5) \
+    M(BBR6) M(BBR7) M(BBS0) M(BBS1) M(BBS2) \
+    M(BBS3) M(BBS4) M(BBS5) M(BBS6) M(BBS7) \
+    M(STP) M(WAI) M(BRK) M(RTI) M(JSR) \
+    M(RTS) M(JMP) M(BIT) M(CLC) M(SEC) \
+    M(CLD) M(SED) M(CLI) M(SEI) M(CLV) \
+    M(NOP) M(SLO) M(RLA) M(SRE) M(RRA) \
+    M(SAX) M(LAX) M(DCP) M(ISC) M(ANC) \
+    M(ANC2) M(ALR) M(ARR) M(XAA) M(AXS) \
+    M(USBC) M(AHX) M(SHY) M(SHX) M(TAS) \
+    M(LAS) M(TRB) M(TSB)
+
+// Keywords that are not mnemonics: registers and directives, with their upper case
+// spelling. K(type, spelling) is expanded once per spelling. .INCLUDE (no trailing
+// word boundary) and .PRINT ON/OFF are recognized by the scanner itself.
+#define TOKEN_KEYWORDS(K) \
+    K(X, "X") K(Y, "Y") K(A, "A") \
+    K(IFDEF_DIR, ".IFDEF") K(IFNDEF_DIR, ".IFNDEF") K(IF_DIR, ".IF") \
+    K(ELSE_DIR, ".ELSE") K(ENDIF_DIR, ".ENDIF") K(FILL_DIR, ".FILL") \
+    K(VAR_DIR, ".VAR") K(DO_DIR, ".DO") K(WHILE_DIR, ".WHILE") \
+    K(WEND_DIR, ".WEND") K(ORG, ".ORG") \
+    K(BYTE, ".BYTE") K(BYTE, ".BYT") K(BYTE, ".DB") K(BYTE, ".TEXT") \
+    K(WORD, ".WORD") K(WORD, ".WRD") K(DS, ".DS") \
+    K(MACRO_DIR, ".MACRO") K(MACRO_DIR, ".MAC") K(INCLUDE, ".INC") \
+    K(ENDMACRO_DIR, ".ENDM") K(ENDMACRO_DIR, ".ENDMACRO")
+
 enum TOKEN_TYPE {
     INVALID = -1,
 
-    ORA, AND, EOR, ADC, SBC,
-    CMP, CPX, CPY, DEC, DEX,
-    DEY, INC, INX, INY, ASL,
-    ROL, LSR, ROR, LDA, STA,
-    LDX, STX, LDY, STY, RMB0,
-    RMB1, RMB2, RMB3, RMB4, RMB5,
-    RMB6, RMB7, SMB0, SMB1, SMB2,
-    SMB3, SMB4, SMB5, SMB6, SMB7,
-    STZ, TAX, TXA, TAY, TYA,
-    TSX, TXS, PLA, PHA, PLP,
-    PHP, PHX, PHY, PLX, PLY,
-    BRA, BPL, BMI, BVC, BVS,
-    BCC, BCS, BNE, BEQ, BBR0,
-    BBR1, BBR2, BBR3, BBR4, BBR5,
-    BBR6, BBR7, BBS0, BBS1, BBS2,
-    BBS3, BBS4, BBS5, BBS6, BBS7,
-    STP, WAI, BRK, RTI, JSR, 
-    RTS, JMP, BIT,
-    CLC, SEC, CLD, SED, CLI,
-    SEI, CLV, NOP, SLO, RLA,
-    SRE, RRA, SAX, LAX, DCP,
-    ISC, ANC, ANC2, ALR, ARR,
-    XAA, AXS, USBC, AHX, SHY,
-    SHX, TAS, LAS, TRB, TSB,
+#define TOKEN_MNEMONIC_ENUM(name) name,
+    TOKEN_MNEMONICS(TOKEN_MNEMONIC_ENUM)
+#undef TOKEN_MNEMONIC_ENUM
 
     DECNUM,     HEXNUM,     BINNUM,     PLUS,       MINUS, 
     MUL,        DIV,        BIT_AND,    BIT_OR,     LPAREN, 
@@ -48,12 +71,17 @@ enum TOKEN_TYPE {
     LAST
 };
 
+// A lexeme. `value` views the retained SourceBuffer the token was lexed from
+// (see source_buffer.h) and `pos` holds an interned file id, so tokens are
+// cheap to copy. `number` is the value of a numeric literal (DECNUM, HEXNUM,
+// BINNUM, OCTNUM, CHAR), decoded once by the Tokenizer; 0 for other tokens.
 struct Token {
     TOKEN_TYPE type = TOKEN_TYPE::INVALID;
-    std::string value = "";
+    std::string_view value = "";
     SourcePos pos = SourcePos();
     size_t line_pos = 0;
     bool start = false;
+    int32_t number = 0;
 
     bool operator==(const Token& other) const
     {
@@ -61,6 +89,7 @@ struct Token {
             type == other.type &&
             value == other.value &&
             pos == other.pos &&
-            line_pos == other.line_pos;
+            line_pos == other.line_pos &&
+            number == other.number;
     }
 };
@@ -0,0 +1,317 @@
+// written by Paul Baxter
+// token_cache.cpp
+//
+// Persistent on-disk token cache. See token_cache.h.
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <random>
+
+#include "token_cache.h"
+#include "tokenizer.h"
+
+extern Tokenizer tokenizer;
+
+TokenCache tokenCache;
+
+//=============================================================================
+// Entry format
+//=============================================================================
+
+// Bump when the entry layout or the meaning of a record changes.
+static constexpr uint32_t TOKEN_CACHE_VERSION = 2;
+
+static constexpr char TOKEN_CACHE_MAGIC[8] = { 'P', 'A', 'S', 'M', 'T', 'O', 'K', '\0' };
+static constexpr uint32_t TOKEN_CACHE_BYTE_ORDER = 0x01020304;
+
+// Offset / line index used when a token has no value / no source line.
+static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+/// <summary>
+/// Entry header, followed by tokenCount records and textSize bytes of text.
+/// </summary>
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t tokenTypes;
+    uint32_t recordSize;
+    uint64_t options;
+    uint64_t key;
+    uint64_t lineCount;
+    uint64_t tokenCount;
+    uint64_t textSize;
+};
+
+/// <summary>
+/// One token.
+/// </summary>
+struct CacheRecord {
+    uint32_t line;      // index into the tokenized lines, or NONE
+    uint32_t offset;    // value offset in the entry text, or NONE for an empty value
+    uint32_t length;    // value length
+    uint32_t linePos;   // Token::line_pos
+    uint16_t type;      // TOKEN_TYPE
+    uint8_t start;      // Token::start
+    uint8_t pad;
+    int32_t number;     // Token::number
+};
+
+static_assert(sizeof(CacheHeader) == 64);
+static_assert(sizeof(CacheRecord) == 24);
+
+/// <summary>
+/// MurmurHash64A of the text, seeded with the options and format version.
+/// </summary>
+static uint64_t hashText(std::string_view text, uint64_t options)
+{
+    constexpr uint64_t m = 0xc6a4a7935bd1e995ull;
+    constexpr int r = 47;
+
+    uint64_t h = (options * 0x9e3779b97f4a7c15ull + TOKEN_CACHE_VERSION) ^ (text.size() * m);
+
+    const char* p = text.data();
+    size_t blocks = text.size() / 8;
+    for (size_t i = 0; i < blocks; ++i, p += 8) {
+        uint64_t k;
+        std::memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    size_t tail = text.size() & 7;
+    if (tail) {
+        uint64_t k = 0;
+        std::memcpy(&k, p, tail);
+        h ^= k;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+//=============================================================================
+// Lookup
+//=============================================================================
+
+/// <summary>
+/// Tokenize the lines of a source file, reusing a cached token stream when
+/// the cache directory holds one for the same text and options.
+/// </summary>
+/// <param name="source">Source lines of one file.</param>
+/// <returns>The tokens, identical to Tokenizer::tokenize(source).</returns>
+std::vector<Token> TokenCache::tokenize(const SourceText& source)
+{
+    if (directory.empty())
+        return tokenizer.tokenize(source);
+
+    auto key = hashText(source.text(), options);
+    auto path = entryPath(key);
+
+    std::vector<Token> tokens;
+    if (load(path, key, source, tokens)) {
+        ++hits;
+        return tokens;
+    }
+
+    ++misses;
+    tokens = tokenizer.tokenize(source);
+    store(path, key, source, tokens);
+    return tokens;
+}
+
+/// <summary>
+/// Path of the entry for a key.
+/// </summary>
+std::string TokenCache::entryPath(uint64_t key) const
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string name(16, '0');
+    for (int i = 15; i >= 0; --i, key >>= 4) {
+        name[i] = digits[key & 0xf];
+    }
+    return (std::filesystem::path(directory) / (name + ".tok")).string();
+}
+
+/// <summary>
+/// Read an entry and rebuild the tokens from it. The entry is read, not
+/// mapped: its text must equal the source text, so token values view the
+/// source text and nothing of a rejected or accepted entry is retained.
+/// </summary>
+/// <param name="path">Entry file.</param>
+/// <param name="key">Expected key.</param>
+/// <param name="source">Lines being tokenized (token positions and values come from here); its text must equal the entry text.</param>
+/// <param name="tokens">Receives the tokens.</param>
+/// <returns>False if there is no usable entry.</returns>
+bool TokenCache::load(const std::string& path, uint64_t key, const SourceText& source, std::vector<Token>& tokens) const
+{
+    auto text = source.text();
+
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec))
+        return false;
+    auto entrySize = std::filesystem::file_size(path, ec);
+    if (ec || entrySize < sizeof(CacheHeader))
+        return false;
+
+    std::ifstream in(path, std::ios::binary);
+    CacheHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+    if (std::memcmp(header.magic, TOKEN_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TOKEN_CACHE_VERSION ||
+        header.byteOrder != TOKEN_CACHE_BYTE_ORDER ||
+        header.tokenTypes != static_cast<uint32_t>(TOKEN_TYPE::LAST) ||
+        header.recordSize != sizeof(CacheRecord) ||
+        header.options != options ||
+        header.key != key ||
+        header.lineCount != source.size() ||
+        header.textSize != text.size()) {
+        return false;
+    }
+
+    auto recordBytes = header.tokenCount * sizeof(CacheRecord);
+    if (header.tokenCount > entrySize || entrySize != sizeof(CacheHeader) + recordBytes + header.textSize)
+        return false;
+
+    std::string body(recordBytes + header.textSize, '\0');
+    if (!in.read(body.data(), body.size()))
+        return false;
+
+    // the key is only a hash; the text decides
+    if (std::string_view(body).substr(recordBytes) != text)
+        return false;
+
+    tokens.clear();
+    tokens.reserve(header.tokenCount);
+    const char* records = body.data();
+    for (uint64_t i = 0; i < header.tokenCount; ++i) {
+        CacheRecord rec;
+        std::memcpy(&rec, records + i * sizeof(CacheRecord), sizeof(rec));
+        if (rec.type >= TOKEN_TYPE::LAST ||
+            (rec.line != NONE && rec.line >= source.size()) ||
+            (rec.offset == NONE ? rec.length != 0 : uint64_t(rec.offset) + rec.length > text.size())) {
+            tokens.clear();
+            return false;
+        }
+
+        Token tok;
+        tok.type = static_cast<TOKEN_TYPE>(rec.type);
+        if (rec.offset != NONE)
+            tok.value = text.substr(rec.offset, rec.length);
+        else
+            tok.value = {};
+        if (rec.line != NONE)
+            tok.pos = source.pos(rec.line);
+        tok.line_pos = rec.linePos;
+        tok.start = rec.start != 0;
+        tok.number = rec.number;
+        tokens.push_back(tok);
+    }
+    return true;
+}
+
+/// <summary>
+/// Write an entry for freshly tokenized lines. Entries are written to a
+/// temporary file and renamed into place so readers never see a partial entry.
+/// Token streams that cannot be expressed in the format are not cached.
+/// </summary>
+/// <param name="path">Entry file.</param>
+/// <param name="key">Entry key.</param>
+/// <param name="source">Lines that were tokenized; the token values view its text.</param>
+/// <param name="tokens">The tokens.</param>
+void TokenCache::store(const std::string& path, uint64_t key, const SourceText& source, const std::vector<Token>& tokens) const
+{
+    auto text = source.text();
+    if (text.size() >= NONE || tokens.size() >= NONE)
+        return;
+
+    std::vector<CacheRecord> records;
+    records.reserve(tokens.size());
+
+    size_t line = 0;
+    for (auto& tok : tokens) {
+        CacheRecord rec = {};
+        rec.type = static_cast<uint16_t>(tok.type);
+        rec.linePos = static_cast<uint32_t>(tok.line_pos);
+        rec.start = tok.start ? 1 : 0;
+        rec.number = tok.number;
+        rec.offset = NONE;
+        rec.length = 0;
+
+        if (tok.line_pos > NONE)
+            return;
+
+        if (!tok.value.empty()) {
+            if (tok.value.data() < text.data() || tok.value.data() + tok.value.size() > text.data() + text.size())
+                return;
+            rec.offset = static_cast<uint32_t>(tok.value.data() - text.data());
+            rec.length = static_cast<uint32_t>(tok.value.size());
+
+            // advance to the line holding the value (its '\n' included)
+            while (line + 1 < source.size() && rec.offset >= source.offset(line + 1)) {
+                ++line;
+            }
+        }
+        else if (tok.value.data() != nullptr) {
+            return;
+        }
+
+        // the token must carry the position of a line at or after the current one
+        auto l = line;
+        while (l < source.size() && !(source.pos(l) == tok.pos)) {
+            ++l;
+        }
+        if (l < source.size()) {
+            rec.line = static_cast<uint32_t>(l);
+        }
+        else if (tok.pos == SourcePos{}) {
+            rec.line = NONE;
+        }
+        else {
+            return;
+        }
+        records.push_back(rec);
+    }
+
+    CacheHeader header = {};
+    std::memcpy(header.magic, TOKEN_CACHE_MAGIC, sizeof(header.magic));
+    header.version = TOKEN_CACHE_VERSION;
+    header.byteOrder = TOKEN_CACHE_BYTE_ORDER;
+    header.tokenTypes = static_cast<uint32_t>(TOKEN_TYPE::LAST);
+    header.recordSize = sizeof(CacheRecord);
+    header.options = options;
+    header.key = key;
+    header.lineCount = source.size();
+    header.tokenCount = records.size();
+    header.textSize = text.size();
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+
+    std::random_device rd;
+    auto temp = path + "." + std::to_string(rd()) + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(CacheRecord)));
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        if (!out) {
+            out.close();
+            std::filesystem::remove(temp, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec)
+        std::filesystem::remove(temp, ec);
+}
@@ -0,0 +1,59 @@
+// written by Paul Baxter
+// token_cache.h
+//
+// Persistent on-disk token cache (-cache DIR).
+//
+//  - The token stream of each tokenized source file is stored in DIR as one
+//    entry named by a 64 bit hash of the file text and the options that are
+//    part of the key (-65c02, -il).
+//  - An entry holds a header, one fixed size record per token and the source
+//    text itself. Token values are (offset, length) pairs into that text, and
+//    positions are line indexes into the lines being tokenized, so an entry is
+//    valid for any file with the same contents.
+//  - On a hit the entry is read and checked, and its token values view the
+//    text being tokenized (equal to the entry text); the Tokenizer is not run
+//    at all and no entry is kept in memory.
+//  - An entry is used only when its magic, format version, byte order, token
+//    type count, record size, key and text all match; anything else (older
+//    versions, other builds, truncated or corrupt files) counts as a miss and
+//    the entry is rewritten.
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common_types.h"
+#include "source_text.h"
+#include "token.h"
+
+class TokenCache {
+public:
+    // Cache directory; empty disables the cache.
+    std::string directory;
+
+    // Option bits that are part of the key (see TokenCacheOption).
+    uint64_t options = 0;
+
+    // Lookup statistics for this run.
+    size_t hits = 0;
+    size_t misses = 0;
+
+    // Tokenize the lines of a source file, reusing a cached token stream when
+    // the directory holds one for the same text and options.
+    std::vector<Token> tokenize(const SourceText& source);
+
+private:
+    std::string entryPath(uint64_t key) const;
+
+    bool load(const std::string& path, uint64_t key, const SourceText& source, std::vector<Token>& tokens) const;
+
+    void store(const std::string& path, uint64_t key, const SourceText& source, const std::vector<Token>& tokens) const;
+};
+
+// Option bits for TokenCache::options.
+constexpr uint64_t TOKEN_CACHE_65C02 = 1;
+constexpr uint64_t TOKEN_CACHE_ILLEGAL = 2;
+
+extern TokenCache tokenCache;
@@ -0,0 +1,681 @@
+// written by Paul Baxter
+// token_store.cpp
+//
+// Structure-of-arrays token stream. See token_store.h.
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
+#include "token_store.h"
+
+//=============================================================================
+// Line table
+//=============================================================================
+
+/// <summary>
+/// Position and text base shared by the tokens of one source line.
+/// </summary>
+struct TokenLine {
+    SourcePos pos;
+    const char* base;
+};
+
+struct TokenLineKey {
+    uint32_t file;
+    size_t line;
+    const char* base;
+
+    bool operator==(const TokenLineKey& other) const = default;
+};
+
+struct TokenLineKeyHash {
+    size_t operator()(const TokenLineKey& key) const
+    {
+        size_t h = std::hash<const void*>()(key.base);
+        h ^= std::hash<size_t>()(key.line) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        h ^= std::hash<uint32_t>()(key.file) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+/// <summary>
+/// Line entries are only ever added (a deque keeps references stable) and are
+/// shared by every TokenStore. Stores are used from the parser thread only.
+/// </summary>
+struct TokenLineTable {
+    std::deque<TokenLine> lines;
+    std::unordered_map<TokenLineKey, uint32_t, TokenLineKeyHash> ids;
+};
+
+static TokenLineTable& tokenLines()
+{
+    static TokenLineTable instance;
+    return instance;
+}
+
+/// <summary>
+/// Return the id of the (position, text base) line entry, adding it on first use.
+/// </summary>
+static uint32_t internLine(const SourcePos& pos, const char* base)
+{
+    auto& t = tokenLines();
+    TokenLineKey key{ pos.file, pos.line, base };
+    auto it = t.ids.find(key);
+    if (it != t.ids.end())
+        return it->second;
+
+    auto id = static_cast<uint32_t>(t.lines.size());
+    t.lines.push_back({ pos, base });
+    t.ids.emplace(key, id);
+    return id;
+}
+
+//=============================================================================
+// Arrays
+//=============================================================================
+
+template <typename F>
+void TokenStore::forEachArray(F f)
+{
+    f(types);
+    f(offsets);
+    f(lengths);
+    f(lines);
+    f(columns);
+    f(starts);
+    f(numbers);
+    f(links);
+}
+
+template <typename F>
+void TokenStore::forEachArray(const TokenStore& other, F f)
+{
+    f(types, other.types);
+    f(offsets, other.offsets);
+    f(lengths, other.lengths);
+    f(lines, other.lines);
+    f(columns, other.columns);
+    f(starts, other.starts);
+    f(numbers, other.numbers);
+    f(links, other.links);
+}
+
+//=============================================================================
+// Access
+//=============================================================================
+
+std::string_view TokenStore::value(size_t i) const
+{
+    i = at(i);
+    if (lengths[i] == 0)
+        return {};
+    return std::string_view(tokenLines().lines[this->lines[i]].base + offsets[i], lengths[i]);
+}
+
+const SourcePos& TokenStore::pos(size_t i) const
+{
+    return tokenLines().lines[lines[at(i)]].pos;
+}
+
+/// <summary>
+/// Rebuild the full token at an index.
+/// </summary>
+Token TokenStore::operator[](size_t i) const
+{
+    i = at(i);
+    auto& line = tokenLines().lines[lines[i]];
+    Token tok;
+    tok.type = static_cast<TOKEN_TYPE>(types[i]);
+    tok.value = lengths[i] == 0 ? std::string_view{} : std::string_view(line.base + offsets[i], lengths[i]);
+    tok.pos = line.pos;
+    tok.line_pos = columns[i];
+    tok.start = starts[i] != 0;
+    tok.number = numbers[i];
+    return tok;
+}
+
+/// <summary>
+/// Tokens [first, last) as a vector.
+/// </summary>
+std::vector<Token> TokenStore::slice(size_t first, size_t last) const
+{
+    std::vector<Token> result;
+    last = std::min(last, size());
+    if (first >= last)
+        return result;
+    result.reserve(last - first);
+    for (auto i = first; i < last; ++i) {
+        result.push_back((*this)[i]);
+    }
+    return result;
+}
+
+/// <summary>
+/// Tokens [first, last) as a store sharing this store's line entries.
+/// </summary>
+TokenStore TokenStore::range(size_t first, size_t last) const
+{
+    TokenStore result;
+    last = std::min(last, size());
+    if (first >= last)
+        return result;
+
+    // the part before the gap, then the part after it
+    size_t before = std::min(last, gapStart);
+    result.forEachArray(*this, [&](auto& to, const auto& from)
+        {
+            to.reserve(last - first);
+            if (first < before)
+                to.insert(to.end(), from.begin() + first, from.begin() + before);
+            if (last > gapStart) {
+                size_t from_first = std::max(first, gapStart) + gapLength;
+                to.insert(to.end(), from.begin() + from_first, from.begin() + last + gapLength);
+            }
+        });
+    for (size_t j = eolBound(first), end = eolBound(last); j < end; ++j) {
+        result.eols.push_back(eolAt(j) - first);
+    }
+    result.eolGapStart = result.eols.size();
+    result.gapStart = result.size();
+    // the copied links are encoded for this store: match the range afresh
+    std::fill(result.links.begin(), result.links.end(), NO_LINK);
+    result.relinkAll();
+    return result;
+}
+
+//=============================================================================
+// EOL index
+//=============================================================================
+
+/// <summary>
+/// Number of EOLs before token index i (the index entry a splice at i goes).
+/// </summary>
+size_t TokenStore::eolBound(size_t i) const
+{
+    size_t low = 0;
+    size_t high = eolCount();
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (eolAt(mid) < i)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+size_t TokenStore::nextEOL(size_t i) const
+{
+    size_t j = eolBound(i);
+    return j < eolCount() ? eolAt(j) : npos;
+}
+
+size_t TokenStore::prevEOL(size_t i) const
+{
+    size_t j = eolBound(i);
+    return j > 0 ? eolAt(j - 1) : npos;
+}
+
+/// <summary>
+/// Move the EOL index gap to entry `to`, converting the entries it passes
+/// between token indexes and distances from the end.
+/// </summary>
+void TokenStore::moveEolGap(size_t to)
+{
+    const size_t n = size();
+    if (to < eolGapStart) {
+        for (size_t k = eolGapStart; k-- > to; ) {
+            eols[k + eolGapLength] = n - eols[k];
+        }
+    }
+    else {
+        for (size_t k = eolGapStart; k < to; ++k) {
+            eols[k] = n - eols[k + eolGapLength];
+        }
+    }
+    eolGapStart = to;
+}
+
+//=============================================================================
+// Directive links
+//=============================================================================
+
+static bool isStructuralDirective(TOKEN_TYPE type)
+{
+    switch (type) {
+        case IF_DIR: case IFDEF_DIR: case IFNDEF_DIR: case ELSE_DIR: case ENDIF_DIR:
+        case DO_DIR: case WHILE_DIR: case WEND_DIR:
+        case MACRO_DIR: case ENDMACRO_DIR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint32_t TokenStore::linkTo(size_t index) const
+{
+    return index < gapStart
+        ? static_cast<uint32_t>(index)
+        : FROM_END | static_cast<uint32_t>(size() - index);
+}
+
+size_t TokenStore::linked(uint32_t link) const
+{
+    return (link & FROM_END) ? size() - (link & ~FROM_END) : link;
+}
+
+size_t TokenStore::partner(size_t i) const
+{
+    uint32_t link = links[at(i)];
+    return link == NO_LINK ? npos : linked(link);
+}
+
+/// <summary>
+/// True for a .else or .endif still linked after the .if of its
+/// conditional was erased (.else <-> .endif, or a lone .endif linked to
+/// itself).
+/// </summary>
+bool TokenStore::openerErased(size_t i) const
+{
+    TOKEN_TYPE t = type(i);
+    if ((t != ELSE_DIR && t != ENDIF_DIR) || links[at(i)] == NO_LINK)
+        return false;
+    size_t next = partner(i);
+    return next == i || ((type(next) == ELSE_DIR || type(next) == ENDIF_DIR) && partner(next) == i);
+}
+
+/// <summary>
+/// Match the directive at index i against the directives still open before
+/// it (tokens are linked in order).
+/// </summary>
+void TokenStore::linkDirective(size_t i)
+{
+    auto link = [this](size_t from, size_t to) { links[at(from)] = linkTo(to); };
+
+    switch (type(i)) {
+        case IF_DIR:
+        case IFDEF_DIR:
+        case IFNDEF_DIR:
+            openConditionals.push_back({ i, npos });
+            break;
+
+        case ELSE_DIR:
+            if (!openConditionals.empty() && openConditionals.back().elseIndex == npos)
+                openConditionals.back().elseIndex = i;
+            break;
+
+        case ENDIF_DIR:
+            if (!openConditionals.empty()) {
+                auto open = openConditionals.back();
+                openConditionals.pop_back();
+                if (open.elseIndex != npos) {
+                    link(open.index, open.elseIndex);
+                    link(open.elseIndex, i);
+                }
+                else {
+                    link(open.index, i);
+                }
+                link(i, open.index);
+            }
+            break;
+
+        case DO_DIR:
+            openLoops.push_back({ i, npos });
+            break;
+
+        case WHILE_DIR:
+            if (!openLoops.empty() && type(openLoops.back().index) == DO_DIR) {
+                link(openLoops.back().index, i);
+                link(i, openLoops.back().index);
+                openLoops.pop_back();
+            }
+            else {
+                openLoops.push_back({ i, npos });
+            }
+            break;
+
+        case WEND_DIR:
+            if (!openLoops.empty() && type(openLoops.back().index) == WHILE_DIR) {
+                link(openLoops.back().index, i);
+                link(i, openLoops.back().index);
+                openLoops.pop_back();
+            }
+            break;
+
+        case MACRO_DIR:
+            openMacros.push_back({ i, npos });
+            break;
+
+        case ENDMACRO_DIR:
+            if (!openMacros.empty()) {
+                link(openMacros.back().index, i);
+                link(i, openMacros.back().index);
+                openMacros.pop_back();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/// <summary>
+/// Match every directive of the store again (after a splice that left
+/// directives unmatched, or an append while the open directives are stale).
+/// </summary>
+void TokenStore::relinkAll()
+{
+    // the closers of erased conditionals do not match by depth: they keep
+    // their links unless the matching gives them others
+    std::vector<std::pair<size_t, size_t>> erasedOpeners;
+    for (size_t i = 0; i < size(); ++i) {
+        if (openerErased(i))
+            erasedOpeners.emplace_back(i, partner(i));
+    }
+
+    std::fill(links.begin(), links.end(), NO_LINK);
+    openConditionals.clear();
+    openLoops.clear();
+    openMacros.clear();
+    openStale = false;
+    for (size_t i = 0; i < size(); ++i) {
+        if (isStructuralDirective(type(i)))
+            linkDirective(i);
+    }
+    for (auto [i, next] : erasedOpeners) {
+        if (links[at(i)] == NO_LINK && (links[at(next)] == NO_LINK || next == i || partner(next) == i))
+            links[at(i)] = linkTo(next);
+    }
+}
+
+/// <summary>
+/// Take the directive at index i out of its cycle. A .if or .else leaves
+/// the rest of its conditional linked (a .endif alone links to itself); any
+/// other directive leaves the directives it was matched with unmatched.
+/// </summary>
+void TokenStore::unlink(size_t i)
+{
+    uint32_t link = links[at(i)];
+    if (link == NO_LINK)
+        return;
+
+    size_t next = linked(link);
+    switch (type(i)) {
+        case IF_DIR:
+        case IFDEF_DIR:
+        case IFNDEF_DIR:
+        case ELSE_DIR:
+        {
+            // the directive before i in the cycle now links past it
+            size_t previous = next;
+            while (linked(links[at(previous)]) != i) {
+                previous = linked(links[at(previous)]);
+            }
+            links[at(previous)] = linkTo(next);
+            break;
+        }
+
+        default:
+            while (next != i) {
+                size_t after = linked(links[at(next)]);
+                links[at(next)] = NO_LINK;
+                next = after;
+            }
+            break;
+    }
+    links[at(i)] = NO_LINK;
+}
+
+//=============================================================================
+// Modification
+//=============================================================================
+
+void TokenStore::clear()
+{
+    forEachArray([](auto& v) { v.clear(); });
+    lastLine = UINT32_MAX;
+    gapStart = 0;
+    gapLength = 0;
+    eols.clear();
+    eolGapStart = 0;
+    eolGapLength = 0;
+    openConditionals.clear();
+    openLoops.clear();
+    openMacros.clear();
+    openStale = false;
+}
+
+void TokenStore::reserve(size_t n)
+{
+    forEachArray([n, this](auto& v) { v.reserve(n + gapLength); });
+}
+
+void TokenStore::assign(const std::vector<Token>& tokens)
+{
+    clear();
+    reserve(tokens.size());
+    for (auto& tok : tokens) {
+        append(tok);
+    }
+}
+
+void TokenStore::push_back(const Token& tok)
+{
+    append(tok);
+}
+
+/// <summary>
+/// Move the gap so that it starts before token `to`, shifting the tokens
+/// between the old and the new gap position across it.
+/// </summary>
+void TokenStore::moveGap(size_t to)
+{
+    if (to == gapStart)
+        return;
+
+    // a directive moved across the gap changes index encoding: encode the
+    // link to it (held by its predecessor in the cycle) for its new side now,
+    // decoding does not depend on the gap
+    size_t offset = to < gapStart ? 0 : gapLength;  // array index - token index
+    for (size_t k = std::min(to, gapStart) + offset, end = std::max(to, gapStart) + offset; k < end; ++k) {
+        // directives are sparse: skip blocks without links (NO_LINK is all ones)
+        if ((k & 63) == 0 && k + 64 <= end) {
+            uint32_t all = NO_LINK;
+            for (size_t j = k; j < k + 64; ++j) {
+                all &= links[j];
+            }
+            if (all == NO_LINK) {
+                k += 63;
+                continue;
+            }
+        }
+        if (links[k] == NO_LINK)
+            continue;
+        size_t i = k - offset;
+        size_t previous = linked(links[k]);
+        for (size_t next; (next = linked(links[at(previous)])) != i; ) {
+            previous = next;
+        }
+        links[at(previous)] = to < gapStart
+            ? FROM_END | static_cast<uint32_t>(size() - i)
+            : static_cast<uint32_t>(i);
+    }
+
+    if (gapLength != 0) {
+        size_t from = gapStart;
+        size_t length = gapLength;
+        forEachArray([from, to, length](auto& v)
+            {
+                if (to < from)
+                    std::move_backward(v.begin() + to, v.begin() + from, v.begin() + from + length);
+                else
+                    std::move(v.begin() + from + length, v.begin() + to + length, v.begin() + from);
+            });
+    }
+    gapStart = to;
+}
+
+/// <summary>
+/// Drop the gap (move it to the end and shrink the arrays; capacity is kept).
+/// </summary>
+void TokenStore::closeGap()
+{
+    moveGap(size());
+    if (gapLength == 0)
+        return;
+    size_t n = size();
+    forEachArray([n](auto& v) { v.resize(n); });
+    gapLength = 0;
+}
+
+/// <summary>
+/// Append a token, sharing the line entry of the previous token when the
+/// position matches and the value lies within 4GB after its text base.
+/// </summary>
+void TokenStore::append(const Token& tok)
+{
+    closeGap();
+    if (eolGapStart != eolCount()) {
+        moveEolGap(eolCount());
+    }
+    if (tok.type == EOL) {
+        if (eolGapLength > 0) {
+            eols.resize(eolCount());
+            eolGapLength = 0;
+        }
+        eols.push_back(size());
+        eolGapStart = eols.size();
+    }
+
+    auto& table = tokenLines();
+    auto data = reinterpret_cast<uintptr_t>(tok.value.data());
+    auto size = tok.value.size();
+
+    uint32_t id = lastLine;
+    bool reuse = false;
+    if (id != UINT32_MAX) {
+        auto& line = table.lines[id];
+        auto base = reinterpret_cast<uintptr_t>(line.base);
+        if (line.pos == tok.pos) {
+            reuse = size == 0 || (base != 0 && data >= base && data - base + size <= UINT32_MAX);
+        }
+    }
+    if (!reuse) {
+        id = internLine(tok.pos, size ? tok.value.data() : nullptr);
+        lastLine = id;
+    }
+
+    types.push_back(static_cast<uint8_t>(tok.type));
+    offsets.push_back(size ? static_cast<uint32_t>(data - reinterpret_cast<uintptr_t>(table.lines[id].base)) : 0);
+    lengths.push_back(static_cast<uint32_t>(size));
+    lines.push_back(id);
+    columns.push_back(static_cast<uint16_t>(std::min<size_t>(tok.line_pos, UINT16_MAX)));
+    starts.push_back(tok.start ? 1 : 0);
+    numbers.push_back(tok.number);
+    links.push_back(NO_LINK);
+    gapStart = this->size();
+
+    if (isStructuralDirective(tok.type)) {
+        if (openStale)
+            relinkAll();
+        else
+            linkDirective(this->size() - 1);
+    }
+}
+
+void TokenStore::insert(size_t at, const std::vector<Token>& tokens)
+{
+    if (at >= size()) {
+        reserve(size() + tokens.size());
+        for (auto& tok : tokens) {
+            append(tok);
+        }
+        return;
+    }
+    insert(at, TokenStore(tokens));
+}
+
+/// <summary>
+/// Insert tokens before index `at` by filling the gap moved there. A gap too
+/// small is widened by at least a quarter of the store, so widening (which
+/// shifts the tail) is rare.
+/// </summary>
+void TokenStore::insert(size_t at, const TokenStore& tokens)
+{
+    size_t count = tokens.size();
+    if (count == 0)
+        return;
+    at = std::min(at, size());
+    moveEolGap(eolBound(at));
+    moveGap(at);
+
+    if (gapLength < count) {
+        size_t widen = std::max(count - gapLength, size() / 4 + 64);
+        size_t end = gapStart + gapLength;
+        forEachArray([end, widen](auto& v) { v.insert(v.begin() + end, widen, {}); });
+        gapLength += widen;
+    }
+
+    // the source may have a gap of its own: copy it in two parts
+    size_t before = std::min(count, tokens.gapStart);
+    size_t to = gapStart;
+    size_t sourceGap = tokens.gapLength;
+    forEachArray(tokens, [to, before, count, sourceGap](auto& into, const auto& from)
+        {
+            std::copy(from.begin(), from.begin() + before, into.begin() + to);
+            std::copy(from.begin() + before + sourceGap, from.begin() + count + sourceGap, into.begin() + to + before);
+        });
+    gapStart += count;
+    gapLength -= count;
+
+    // links of the inserted directives, now token indexes before the gap; a
+    // directive the inserted tokens do not match can change the matching
+    // around it, so then everything is matched again
+    bool unmatched = false;
+    for (size_t j = 0; j < count; ++j) {
+        uint32_t link = tokens.links[tokens.at(j)];
+        if (link != NO_LINK)
+            links[to + j] = linkTo(at + tokens.linked(link));
+        if ((link == NO_LINK && isStructuralDirective(tokens.type(j))) || tokens.type(j) == WHILE_DIR)
+            unmatched = true;
+    }
+    if (unmatched)
+        relinkAll();
+    else if (!openConditionals.empty() || !openLoops.empty() || !openMacros.empty())
+        openStale = true;
+
+    // index the inserted EOLs (the entries after the index gap are relative
+    // to the end and stay valid)
+    size_t added = tokens.eolCount();
+    if (eolGapLength < added) {
+        size_t widen = std::max(added - eolGapLength, eolCount() / 4 + 16);
+        eols.insert(eols.begin() + eolGapStart + eolGapLength, widen, 0);
+        eolGapLength += widen;
+    }
+    for (size_t j = 0; j < added; ++j) {
+        eols[eolGapStart++] = at + tokens.eolAt(j);
+    }
+    eolGapLength -= added;
+}
+
+/// <summary>
+/// Erase tokens [first, last) by moving the gap to `first` and widening it
+/// over them.
+/// </summary>
+void TokenStore::erase(size_t first, size_t last)
+{
+    last = std::min(last, size());
+    if (first >= last)
+        return;
+    size_t firstEol = eolBound(first);
+    size_t lastEol = eolBound(last);
+    moveEolGap(firstEol);
+    eolGapLength += lastEol - firstEol;
+    moveGap(first);
+    for (size_t i = first; i < last; ++i) {
+        unlink(i);
+    }
+    gapLength += last - first;
+    if (!openConditionals.empty() || !openLoops.empty() || !openMacros.empty())
+        openStale = true;
+}
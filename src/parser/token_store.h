@@ -0,0 +1,179 @@
+// written by Paul Baxter
+// token_store.h
+//
+// Structure-of-arrays token stream used by the Parser.
+//
+//  - Each field of a token lives in its own dense array: an 8 bit type, a
+//    32 bit value offset and length, a 32 bit line id, a 16 bit column, a
+//    start flag and the 32 bit literal value (21 bytes per token instead of a
+//    ~56 byte Token).
+//  - parse_rule and the EOL / directive scans only read the type array, so
+//    the hot terminal compare `type(current_pos) != expected` stays in a few
+//    cache lines.
+//  - A line id names an entry of a shared line table holding the SourcePos and
+//    the text base the value offsets are relative to. Consecutive tokens of a
+//    line share an entry, so building a store costs one table lookup per line.
+//  - operator[] rebuilds a full Token on demand (rule arguments, diagnostics).
+//  - Columns saturate at 65535; they are only used in diagnostics.
+//  - The arrays are gap buffers: the unused slots of every array sit at one
+//    index (the gap), and insert / erase move the gap to the edit point.
+//    Macro expansion, .include and .fill replace the line just parsed, and a
+//    conditional erases from its directive line to the block it keeps; the
+//    .else / .endif lines after that block are erased when the parse reaches
+//    them (Parser::DropConditionalCloser). Every splice the grammar makes
+//    starts at the parse position, which only moves forward except when a
+//    loop lookahead backtracks, so a splice costs the tokens inserted or
+//    erased plus the distance from the previous splice instead of shifting
+//    the whole tail. An edit anywhere else (Parser::RemoveLineRange, which
+//    the grammar does not use) pays for moving the gap there and back.
+//    Index access costs one compare.
+//  - The positions of the EOL tokens are kept in a sorted index, a gap buffer
+//    that follows the token gap: entries before its gap hold the token index,
+//    entries after it the distance from the end of the store, so a splice
+//    never renumbers the lines after it. nextEOL / prevEOL binary search it.
+//  - Structural directives are matched when tokens are added: each one links
+//    to its partner (see partner()). Links use the same encoding as the EOL
+//    index (token index before the gap, distance from the end after it), so
+//    a splice only relinks the directives it inserts, erases or moves the gap
+//    over. Conditionals, loops and macros are matched independently, a
+//    conditional exactly like the depth counting scan it replaces.
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "common_types.h"
+#include "token.h"
+
+static_assert(TOKEN_TYPE::LAST <= 256, "token types must fit the 8 bit type array");
+
+class TokenStore {
+public:
+    TokenStore() = default;
+    TokenStore(const std::vector<Token>& tokens) { assign(tokens); }
+
+    TokenStore& operator=(const std::vector<Token>& tokens)
+    {
+        assign(tokens);
+        return *this;
+    }
+
+    size_t size() const { return types.size() - gapLength; }
+    bool empty() const { return size() == 0; }
+
+    // Token fields. type() only touches the type array.
+    TOKEN_TYPE type(size_t i) const { return static_cast<TOKEN_TYPE>(types[at(i)]); }
+    std::string_view value(size_t i) const;
+    const SourcePos& pos(size_t i) const;
+    size_t column(size_t i) const { return columns[at(i)]; }
+    bool start(size_t i) const { return starts[at(i)] != 0; }
+    int32_t number(size_t i) const { return numbers[at(i)]; }
+
+    // Full token at index i.
+    Token operator[](size_t i) const;
+
+    // Tokens [first, last) as a vector.
+    std::vector<Token> slice(size_t first, size_t last) const;
+
+    // Tokens [first, last) as a store (copies the arrays, no Token rebuild).
+    TokenStore range(size_t first, size_t last) const;
+
+    // Index of the first EOL at or after i, or npos if there is none.
+    size_t nextEOL(size_t i) const;
+
+    // Index of the last EOL before i, or npos if there is none.
+    size_t prevEOL(size_t i) const;
+
+    // Matching directive of the directive at index i, or npos if it has none:
+    //  .if/.ifdef/.ifndef -> its .else, or its .endif if it has no .else
+    //  .else -> .endif, .endif -> .if (the three form a cycle)
+    //  .do <-> .while, .while <-> .wend, .macro <-> .endm
+    // A .while closes an open .do, otherwise it starts a .while loop. Only
+    // the first .else of a conditional is linked. Erasing a .if or .else
+    // leaves the rest of its conditional linked (.else <-> .endif, or a
+    // .endif linked to itself); erasing any other directive leaves the
+    // partners it had unmatched.
+    size_t partner(size_t i) const;
+
+    // True for a .else or .endif whose .if was erased: the parser took the
+    // conditional and drops the line when it gets there.
+    bool openerErased(size_t i) const;
+
+    static constexpr size_t npos = SIZE_MAX;
+
+    void clear();
+    void reserve(size_t n);
+    void assign(const std::vector<Token>& tokens);
+    void push_back(const Token& tok);
+
+    // Insert tokens before index `at`.
+    void insert(size_t at, const std::vector<Token>& tokens);
+    void insert(size_t at, const TokenStore& tokens);
+
+    // Erase tokens [first, last).
+    void erase(size_t first, size_t last);
+
+private:
+    std::vector<uint8_t> types;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<uint32_t> lines;
+    std::vector<uint16_t> columns;
+    std::vector<uint8_t> starts;
+    std::vector<int32_t> numbers;
+    std::vector<uint32_t> links;    // encoded partner (linkTo) or NO_LINK
+
+    // Line id of the most recently added token (reused while tokens share a line).
+    uint32_t lastLine = UINT32_MAX;
+
+    // Unused slots [gapStart, gapStart + gapLength) of every array.
+    size_t gapStart = 0;
+    size_t gapLength = 0;
+
+    // Array index of token i.
+    size_t at(size_t i) const { return i < gapStart ? i : i + gapLength; }
+
+    // EOL index: [0, eolGapStart) token indexes, then eolGapLength unused
+    // slots, then distances from the end (size() - index).
+    std::vector<size_t> eols;
+    size_t eolGapStart = 0;
+    size_t eolGapLength = 0;
+
+    size_t eolCount() const { return eols.size() - eolGapLength; }
+    size_t eolAt(size_t j) const { return j < eolGapStart ? eols[j] : size() - eols[j + eolGapLength]; }
+
+    // Number of EOLs before token index i.
+    size_t eolBound(size_t i) const;
+    void moveEolGap(size_t to);
+
+    // Apply f to every array (of this store and of another store).
+    template <typename F> void forEachArray(F f);
+    template <typename F> void forEachArray(const TokenStore& other, F f);
+
+    // Directive links: the partner's token index before the gap, or
+    // FROM_END | (size() - index) after it.
+    static constexpr uint32_t NO_LINK = UINT32_MAX;
+    static constexpr uint32_t FROM_END = 0x80000000u;
+
+    uint32_t linkTo(size_t index) const;
+    size_t linked(uint32_t link) const;
+
+    // Directives still open while tokens are appended (token indexes); stale
+    // after an insert or erase, when the next appended directive relinks all.
+    struct OpenDirective {
+        size_t index;
+        size_t elseIndex;
+    };
+    std::vector<OpenDirective> openConditionals;
+    std::vector<OpenDirective> openLoops;
+    std::vector<OpenDirective> openMacros;
+    bool openStale = false;
+
+    void linkDirective(size_t i);
+    void relinkAll();
+    void unlink(size_t i);
+
+    void moveGap(size_t to);
+    void closeGap();
+    void append(const Token& tok);
+};
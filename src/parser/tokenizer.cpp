@@ -1,11 +1,124 @@
 // written by Paul Baxter
 // Tokenizer.cpp
+#include <array>
 #include <cctype>
+#include <cstdint>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <thread>
 
 #include "tokenizer.h"
 #include "expr_rules.h"
+#include "keywords.h"
+#include "source_buffer.h"
+
+// Smallest number of lines worth handing to a tokenizer thread.
+static constexpr size_t MIN_CHUNK_LINES = 512;
+
+//=============================================================================
+// Scanner tables
+//=============================================================================
+
+// Character attribute bits
+enum : uint8_t {
+    CH_WORD = 0x01,     // [A-Za-z0-9_]  (\w, used for \b)
+    CH_IDENT = 0x02,    // [A-Za-z_]     (first character of a symbol)
+    CH_DIGIT = 0x04,    // [0-9]
+    CH_HEX = 0x08,      // [0-9A-Fa-f]
+    CH_OCT = 0x10,      // [0-7]
+    CH_BIN = 0x20,      // [0-1]
+    CH_BLANK = 0x40,    // [ \t]
+};
+
+// Start states: the lexeme family selected by the first character
+enum ScanState : uint8_t {
+    S_ERROR,            // no pattern can start with this character
+    S_SINGLE,           // single character operator (type in singleTokens)
+    S_COMMENT,          // ;...
+    S_NUMBER,           // decimal or 0 prefixed octal
+    S_QUOTE,            // character constant or text
+    S_DOLLAR,           // hex number
+    S_PERCENT,          // binary number or modulo
+    S_AMP,              // && &17 &
+    S_PIPE,             // || |
+    S_LESS,             // <= <> << <
+    S_GREATER,          // >= >> >
+    S_EQUAL,            // == =
+    S_BANG,             // !=
+    S_AT,               // @local @
+    S_BACKSLASH,        // \1 macro parameter
+    S_BLANK,            // white space
+    S_IDENT,            // symbol, mnemonic, register or o17 octal
+    S_DOT,              // directive
+    S_CR,               // \r\n
+    S_NL,               // \n
+};
+
+static constexpr std::array<uint8_t, 256> charFlags = [] {
+    std::array<uint8_t, 256> t{};
+    for (int c = 0; c < 256; ++c) {
+        uint8_t f = 0;
+        bool upper = c >= 'A' && c <= 'Z';
+        bool lower = c >= 'a' && c <= 'z';
+        bool digit = c >= '0' && c <= '9';
+        if (upper || lower || digit || c == '_') f |= CH_WORD;
+        if (upper || lower || c == '_') f |= CH_IDENT;
+        if (digit) f |= CH_DIGIT;
+        if (digit || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f')) f |= CH_HEX;
+        if (c >= '0' && c <= '7') f |= CH_OCT;
+        if (c == '0' || c == '1') f |= CH_BIN;
+        if (c == ' ' || c == '\t') f |= CH_BLANK;
+        t[c] = f;
+    }
+    return t;
+}();
+
+static constexpr std::array<uint8_t, 256> startState = [] {
+    std::array<uint8_t, 256> t{};
+    for (int c = 0; c < 256; ++c) {
+        if (charFlags[c] & CH_IDENT) t[c] = S_IDENT;
+        else if (charFlags[c] & CH_DIGIT) t[c] = S_NUMBER;
+        else if (charFlags[c] & CH_BLANK) t[c] = S_BLANK;
+    }
+    for (auto c : { '+', '-', ',', ':', '#', '*', '/', '~', '(', ')' }) t[c] = S_SINGLE;
+    t[';'] = S_COMMENT;
+    t['\''] = S_QUOTE;
+    t['"'] = S_QUOTE;
+    t['$'] = S_DOLLAR;
+    t['%'] = S_PERCENT;
+    t['&'] = S_AMP;
+    t['|'] = S_PIPE;
+    t['<'] = S_LESS;
+    t['>'] = S_GREATER;
+    t['='] = S_EQUAL;
+    t['!'] = S_BANG;
+    t['@'] = S_AT;
+    t['\\'] = S_BACKSLASH;
+    t['.'] = S_DOT;
+    t['\r'] = S_CR;
+    t['\n'] = S_NL;
+    return t;
+}();
+
+static constexpr std::array<TOKEN_TYPE, 256> singleTokens = [] {
+    std::array<TOKEN_TYPE, 256> t{};
+    t.fill(INVALID);
+    t['+'] = PLUS;
+    t['-'] = MINUS;
+    t[','] = COMMA;
+    t[':'] = COLAN;
+    t['#'] = POUND;
+    t['*'] = MUL;
+    t['/'] = DIV;
+    t['~'] = ONESCOMP;
+    t['('] = LPAREN;
+    t[')'] = RPAREN;
+    return t;
+}();
 
 /// <summary>
 /// Constructs a Tokenizer and initializes it with a list of token type and pattern pairs.
@@ -24,24 +137,38 @@ Tokenizer::Tokenizer(std::initializer_list<std::pair<TOKEN_TYPE, std::string>> p
 /// <param name="input">A vector of pairs, each containing a source position and the corresponding line of source code as a string.</param>
 /// <returns>A vector containing all tokens extracted from the input lines.</returns>
 std::vector<Token> Tokenizer::tokenize(const std::vector<std::pair<SourcePos, std::string>>& input)
+{
+    // all lines share one buffer
+    return tokenize(SourceText(input));
+}
+
+/// <summary>
+/// Tokenizes source lines held in a retained buffer; token values view the buffer.
+/// </summary>
+/// <param name="input">Source lines.</param>
+/// <returns>A vector containing all tokens extracted from the input lines.</returns>
+std::vector<Token> Tokenizer::tokenize(const SourceText& input)
 {
 #ifdef __SHOW_TOKINIZE_TIME__
     auto start_time = std::chrono::high_resolution_clock::now();
 #endif
 
     std::vector<Token> tokens;
-    for (const auto& [pos, str] : input) {
-        tokenize(pos, str, tokens);
+    if (jobs > 1 && input.size() >= 2 * MIN_CHUNK_LINES) {
+        tokenizeParallel(input, tokens);
+    }
+    else {
+        tokenizeLines(input, 0, input.size(), tokens);
     }
 
     // ensure we always terminate the token stream with an EOL so the parser
     // will handle a final-line label even when the input file lacks a trailing newline.
     Token eolTok;
     eolTok.type = TOKEN_TYPE::EOL;
-    eolTok.value.clear();
+    eolTok.value = {};
     // use the last source position if available so listings point to the correct line
     if (!input.empty()) {
-        eolTok.pos = input.back().first;
+        eolTok.pos = input.pos(input.size() - 1);
     } else {
         eolTok.pos = SourcePos{}; // default
     }
@@ -67,12 +194,515 @@ std::vector<Token> Tokenizer::tokenize(const std::vector<std::pair<SourcePos, st
 }
 
 /// <summary>
-/// Tokenizes the input string into a sequence of tokens based on predefined patterns.
+/// Tokenizes input lines [first, last). Each line is followed by '\n' in the buffer.
+/// </summary>
+/// <param name="input">Source lines.</param>
+/// <param name="first">First line to tokenize.</param>
+/// <param name="last">One past the last line to tokenize.</param>
+/// <param name="tokens">Vector the tokens are appended to.</param>
+void Tokenizer::tokenizeLines(const SourceText& input, size_t first, size_t last, std::vector<Token>& tokens) const
+{
+    if (first == last)
+        return;
+
+    // one scan of the text of the lines classifies all of them; a line
+    // holding a '\n' of its own (joined lines) splits differently, those
+    // lines are summarized one at a time
+    std::vector<SourceLine> summaries;
+    if (!useRegex) {
+        const size_t base = input.offset(first);
+        summaries = scanSource(input.text().substr(base, input.offset(last) - base));
+        if (summaries.size() != last - first)
+            summaries.clear();
+    }
+
+    for (auto i = first; i < last; ++i) {
+        if (summaries.empty())
+            tokenizeLine(input.pos(i), input.line(i), tokens);
+        else
+            scan(input.pos(i), input.line(i), summaries[i - first], tokens);
+    }
+}
+
+/// <summary>
+/// Tokenizes the lines on `jobs` threads.
+/// Lines are split into contiguous chunks that workers take in turn. Each chunk is lexed
+/// into its own vector and the vectors are joined in line order; if lexing fails the
+/// error from the earliest chunk is rethrown, so the result matches a single threaded run.
+/// </summary>
+/// <param name="input">Source lines.</param>
+/// <param name="tokens">Vector the tokens are appended to.</param>
+void Tokenizer::tokenizeParallel(const SourceText& input, std::vector<Token>& tokens) const
+{
+    struct Chunk {
+        size_t first;
+        size_t last;
+        std::vector<Token> tokens;
+        std::exception_ptr error;
+    };
+
+    // a few chunks per thread evens out lines of different cost
+    size_t count = std::min<size_t>(static_cast<size_t>(jobs) * 4, input.size() / MIN_CHUNK_LINES);
+    size_t per = (input.size() + count - 1) / count;
+
+    std::vector<Chunk> chunks;
+    for (size_t first = 0; first < input.size(); first += per) {
+        chunks.push_back({ first, std::min(first + per, input.size()), {}, nullptr });
+    }
+
+    std::atomic<size_t> next = 0;
+    auto worker = [&]()
+        {
+            for (size_t c; (c = next++) < chunks.size();) {
+                auto& chunk = chunks[c];
+                chunk.tokens.reserve((chunk.last - chunk.first) * 4);
+                try {
+                    tokenizeLines(input, chunk.first, chunk.last, chunk.tokens);
+                }
+                catch (...) {
+                    chunk.error = std::current_exception();
+                }
+            }
+        };
+
+    auto threads = std::min<size_t>(jobs, chunks.size());
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (size_t t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& th : pool) {
+        th.join();
+    }
+
+    size_t total = 0;
+    for (auto& chunk : chunks) {
+        if (chunk.error)
+            std::rethrow_exception(chunk.error);
+        total += chunk.tokens.size();
+    }
+    tokens.reserve(tokens.size() + total + 1);
+    for (auto& chunk : chunks) {
+        tokens.insert(tokens.end(), chunk.tokens.begin(), chunk.tokens.end());
+    }
+}
+
+/// <summary>
+/// Tokenizes the input string into a sequence of tokens.
 /// </summary>
 /// <param name="sourcepos">The source position information, including filename and line number, used for error reporting and token metadata.</param>
 /// <param name="input">The input string to be tokenized.</param>
-/// <returns>A vector of Token objects representing the tokens extracted from the input string.</returns>
+/// <param name="tokens">Vector the tokens are appended to.</param>
 void Tokenizer::tokenize(const SourcePos& sourcepos, const std::string& input, std::vector<Token>& tokens)
+{
+    auto buffer = retainText(input + "\n");
+    tokenizeLine(sourcepos, buffer.substr(0, input.size()), tokens);
+}
+
+//=============================================================================
+// Numeric literals
+//=============================================================================
+
+/// <summary>
+/// Value of a digit in a base, or the base itself if c is not a digit of it.
+/// </summary>
+static uint32_t digitValue(char c, uint32_t base)
+{
+    uint32_t d = base;
+    if (c >= '0' && c <= '9')
+        d = c - '0';
+    else if (c >= 'a' && c <= 'f')
+        d = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+        d = c - 'A' + 10;
+    return d < base ? d : base;
+}
+
+/// <summary>
+/// Decodes the value of a numeric literal token so the grammar never parses
+/// the text again. Prefixes ($, %, 0o, o, &) and the blanks between digit
+/// groups are skipped; a CHAR yields the character after the quote.
+/// Literals must fit in 32 bits.
+/// </summary>
+/// <param name="sourcepos">The source position used for errors.</param>
+/// <param name="type">Token type.</param>
+/// <param name="value">Token text.</param>
+/// <returns>The literal value, or 0 if the token is not a numeric literal.</returns>
+static int32_t decodeNumber(const SourcePos& sourcepos, TOKEN_TYPE type, std::string_view value)
+{
+    uint32_t base = 10;
+    size_t i = 0;
+    switch (type) {
+        case DECNUM:
+            break;
+
+        case HEXNUM:
+            base = 16;
+            i = 1;
+            break;
+
+        case BINNUM:
+            base = 2;
+            i = 1;
+            break;
+
+        case OCTNUM:
+            base = 8;
+            if (value.size() > 1 && value[0] == '0' && (value[1] == 'o' || value[1] == 'O'))
+                i = 2;
+            else if (!value.empty() && (value[0] == 'o' || value[0] == 'O' || value[0] == '&'))
+                i = 1;
+            break;
+
+        case CHAR:
+            return value.size() > 1 ? static_cast<char>(value[1]) : 0;
+
+        default:
+            return 0;
+    }
+
+    uint64_t n = 0;
+    for (; i < value.size(); ++i) {
+        auto c = value[i];
+        if (std::isspace(static_cast<unsigned char>(c)))
+            continue;
+        auto d = digitValue(c, base);
+        if (d == base)
+            break;
+        n = n * base + d;
+        if (n > UINT32_MAX) {
+            throw std::runtime_error("Number out of range at position " + sourcepos.filename() + " " + std::to_string(sourcepos.line));
+        }
+    }
+    return static_cast<int32_t>(static_cast<uint32_t>(n));
+}
+
+/// <summary>
+/// Tokenizes one line of a retained buffer with the scanner or the regex patterns.
+/// </summary>
+/// <param name="sourcepos">The source position used for each produced Token and for errors.</param>
+/// <param name="input">The line; the buffer holds a '\n' right after it.</param>
+/// <param name="tokens">Vector the tokens are appended to.</param>
+void Tokenizer::tokenizeLine(const SourcePos& sourcepos, std::string_view input, std::vector<Token>& tokens) const
+{
+    if (useRegex) {
+        tokenizeRegex(sourcepos, input, tokens);
+        return;
+    }
+    scan(sourcepos, input, scanLine(input), tokens);
+}
+
+/// <summary>
+/// Scans one line with the table driven automaton.
+/// The line is followed by a '\n' in its buffer, exactly like the regex
+/// implementation which appends "\n" before matching; token values view the buffer.
+/// </summary>
+/// <param name="sourcepos">The source position used for each produced Token and for errors.</param>
+/// <param name="input">The line to scan.</param>
+/// <param name="line">Front end summary of the line: leading blanks and the comment start.</param>
+/// <param name="tokens">Vector the tokens are appended to.</param>
+void Tokenizer::scan(const SourcePos& sourcepos, std::string_view input, const SourceLine& line, std::vector<Token>& tokens) const
+{
+    const char* s = input.data();
+    const size_t n = input.size();
+
+    // character at i; the trailing newline is at n, -1 past the end
+    auto ch = [s, n](size_t i) -> int
+        {
+            return i <= n ? static_cast<unsigned char>(s[i]) : -1;
+        };
+    auto is = [&ch](size_t i, uint8_t flags) -> bool
+        {
+            auto c = ch(i);
+            return c >= 0 && (charFlags[c] & flags) != 0;
+        };
+    auto run = [&is](size_t i, uint8_t flags) -> size_t
+        {
+            while (is(i, flags))
+                ++i;
+            return i;
+        };
+    auto upper = [](int c) -> int
+        {
+            return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+        };
+    auto startsWithUpper = [&upper](std::string_view text, std::string_view prefix) -> bool
+        {
+            if (text.size() < prefix.size())
+                return false;
+            for (size_t i = 0; i < prefix.size(); ++i) {
+                if (upper(static_cast<unsigned char>(text[i])) != prefix[i])
+                    return false;
+            }
+            return true;
+        };
+
+    // leading blanks are a WS token: skip them
+    size_t pos = line.indent, line_pos = 1 + line.indent;
+    bool start = true;
+
+    while (pos <= n) {
+        TOKEN_TYPE type = INVALID;
+        size_t end = pos;
+        const int c = ch(pos);
+
+        switch (startState[c]) {
+            case S_SINGLE:
+                type = singleTokens[c];
+                end = pos + 1;
+                break;
+
+            case S_COMMENT:
+                type = COMMENT;
+                if (pos == line.comment) {
+                    end = n;
+                    break;
+                }
+                end = pos + 1;
+                while (end < n && s[end] != '\n')
+                    ++end;
+                break;
+
+            case S_NUMBER: {
+                // \d+ against 0[0-7]+ | 0[oO][0-7]+ ; equal length goes to DECNUM
+                type = DECNUM;
+                end = run(pos, CH_DIGIT);
+                if (c == '0') {
+                    size_t oct = run(pos + 1, CH_OCT);
+                    if (oct == pos + 1 && upper(ch(pos + 1)) == 'O' && is(pos + 2, CH_OCT))
+                        oct = run(pos + 2, CH_OCT);
+                    if (oct > pos + 1 && oct > end) {
+                        type = OCTNUM;
+                        end = oct;
+                    }
+                }
+                break;
+            }
+
+            case S_QUOTE: {
+                // CHAR: 'x' or '\'' ; TEXT: quoted string with \ escapes.
+                // The longer lexeme wins, CHAR wins a tie.
+                size_t charEnd = pos;
+                auto c1 = ch(pos + 1);
+                if (c1 >= 0 && c1 != c && ch(pos + 2) == c)
+                    charEnd = pos + 3;
+                else if (c1 == '\\' && ch(pos + 2) == c && ch(pos + 3) == c)
+                    charEnd = pos + 4;
+
+                size_t textEnd = pos;
+                for (size_t i = pos + 1; ch(i) >= 0; ++i) {
+                    auto t = ch(i);
+                    if (t == c) {
+                        textEnd = i + 1;
+                        break;
+                    }
+                    if (t == '\\') {
+                        if (ch(i + 1) < 0)
+                            break;
+                        ++i;
+                    }
+                }
+                if (textEnd > charEnd) {
+                    type = TEXT;
+                    end = textEnd;
+                }
+                else if (charEnd > pos) {
+                    type = CHAR;
+                    end = charEnd;
+                }
+                break;
+            }
+
+            case S_DOLLAR:
+            case S_PERCENT: {
+                // $hex or %bin; groups separated by blanks belong to the same number
+                uint8_t digits = c == '$' ? CH_HEX : CH_BIN;
+                size_t i = run(pos + 1, digits);
+                if (i > pos + 1) {
+                    type = c == '$' ? HEXNUM : BINNUM;
+                    for (;;) {
+                        size_t blank = run(i, CH_BLANK);
+                        if (blank == i || !is(blank, digits))
+                            break;
+                        i = run(blank, digits);
+                    }
+                    end = i;
+                }
+                else if (c == '%') {
+                    type = MOD;
+                    end = pos + 1;
+                }
+                break;
+            }
+
+            case S_AMP:
+                if (ch(pos + 1) == '&') {
+                    type = LOGICAL_AND;
+                    end = pos + 2;
+                }
+                else if (is(pos + 1, CH_OCT)) {
+                    type = OCTNUM;
+                    end = run(pos + 1, CH_OCT);
+                }
+                else {
+                    type = BIT_AND;
+                    end = pos + 1;
+                }
+                break;
+
+            case S_PIPE:
+                type = ch(pos + 1) == '|' ? LOGICAL_OR : BIT_OR;
+                end = pos + (type == LOGICAL_OR ? 2 : 1);
+                break;
+
+            case S_LESS:
+                switch (ch(pos + 1)) {
+                    case '=': type = LE; break;
+                    case '>': type = NOTEQUAL; break;
+                    case '<': type = SLEFT; break;
+                    default: type = LT; break;
+                }
+                end = pos + (type == LT ? 1 : 2);
+                break;
+
+            case S_GREATER:
+                switch (ch(pos + 1)) {
+                    case '=': type = GE; break;
+                    case '>': type = SRIGHT; break;
+                    default: type = GT; break;
+                }
+                end = pos + (type == GT ? 1 : 2);
+                break;
+
+            case S_EQUAL:
+                type = ch(pos + 1) == '=' ? DEQUAL : EQUAL;
+                end = pos + (type == DEQUAL ? 2 : 1);
+                break;
+
+            case S_BANG:
+                if (ch(pos + 1) == '=') {
+                    type = NOTEQUAL;
+                    end = pos + 2;
+                }
+                break;
+
+            case S_AT:
+                if (is(pos + 1, CH_IDENT)) {
+                    type = LOCALSYM;
+                    end = run(pos + 1, CH_WORD);
+                }
+                else {
+                    type = AT;
+                    end = pos + 1;
+                }
+                break;
+
+            case S_BACKSLASH:
+                if (is(pos + 1, CH_DIGIT)) {
+                    type = MACRO_PARAM;
+                    end = run(pos + 1, CH_DIGIT);
+                }
+                break;
+
+            case S_BLANK:
+                type = WS;
+                end = run(pos, CH_BLANK);
+                break;
+
+            case S_IDENT: {
+                // the whole word is the lexeme; \b on both sides of a keyword
+                // therefore means the word equals the keyword.
+                end = run(pos, CH_WORD);
+                if (upper(c) == 'O' && end > pos + 1 && run(pos + 1, CH_OCT) == end) {
+                    type = OCTNUM;
+                    break;
+                }
+                type = lookupKeyword(input.substr(pos, end - pos));
+                if (type == INVALID)
+                    type = SYM;
+                break;
+            }
+
+            case S_DOT: {
+                size_t wordEnd = run(pos + 1, CH_WORD);
+                auto word = input.substr(pos, wordEnd - pos);
+
+                // .INCLUDE has no trailing \b
+                if (startsWithUpper(word, ".INCLUDE")) {
+                    type = INCLUDE;
+                    end = pos + 8;
+                    break;
+                }
+
+                // .PRINT[ \t]+ON / .PRINT[ \t]+OFF
+                if (word.size() == 6 && startsWithUpper(word, ".PRINT")) {
+                    size_t i = run(wordEnd, CH_BLANK);
+                    auto rest = input.substr(std::min(i, n));
+                    if (i > wordEnd && startsWithUpper(rest, "ON")) {
+                        type = PRINT_ON;
+                        end = i + 2;
+                    }
+                    else if (i > wordEnd && startsWithUpper(rest, "OFF")) {
+                        type = PRINT_OFF;
+                        end = i + 3;
+                    }
+                    break;
+                }
+
+                type = lookupKeyword(word);
+                end = wordEnd;
+                break;
+            }
+
+            case S_CR:
+                if (ch(pos + 1) == '\n') {
+                    type = EOL;
+                    end = pos + 2;
+                }
+                break;
+
+            case S_NL:
+                type = EOL;
+                end = pos + 1;
+                break;
+
+            default:
+                break;
+        }
+
+        if (type == INVALID || end == pos) {
+            throw std::runtime_error("Unknown token at position " + sourcepos.filename() + " " + std::to_string(sourcepos.line));
+        }
+
+        std::string_view value(s + pos, end - pos);
+        if (type != WS) {
+            tokens.push_back(Token{ type, value, sourcepos, line_pos, start, decodeNumber(sourcepos, type, value) });
+        }
+
+        for (char v : value) {
+            if (v == '\n') {
+                line_pos = 1;
+                start = true;
+            }
+            else {
+                ++line_pos;
+                if (type != WS) {
+                    start = false;
+                }
+            }
+        }
+        pos = end;
+    }
+}
+
+/// <summary>
+/// Tokenizes the input string into a sequence of tokens based on predefined patterns.
+/// </summary>
+/// <param name="sourcepos">The source position information, including filename and line number, used for error reporting and token metadata.</param>
+/// <param name="input">The line, without its newline.</param>
+/// <param name="tokens">Vector the tokens are appended to.</param>
+void Tokenizer::tokenizeRegex(const SourcePos& sourcepos, std::string_view input, std::vector<Token>& tokens) const
 {
 #ifdef __USE_STD_REGEX__
     using namespace std;
@@ -81,16 +711,19 @@ void Tokenizer::tokenize(const SourcePos& sourcepos, const std::string& input, s
     using namespace boost;
 #endif
     size_t pos = 0, line_pos = 1;
-    const auto fullline = input + "\n";
+
+    // the patterns match the line with its newline; token values are views of
+    // that text, so it is retained like generated text
+    const std::string_view fullline = retainText(std::string(input) + "\n");
     bool start = true;
 
     smatch bestMatch;
 
     while (pos < fullline.size()) {
-        TOKEN_TYPE bestType;
+        TOKEN_TYPE bestType = INVALID;
         size_t bestLength = 0;
 
-        std::string remaining = fullline.substr(pos);
+        std::string remaining(fullline.substr(pos));
         for (const auto& [type, regex] : token_patterns) {
             smatch match;
             if (regex_search(remaining, match, regex, regex_constants::match_continuous)) {
@@ -104,15 +737,15 @@ void Tokenizer::tokenize(const SourcePos& sourcepos, const std::string& input, s
             }
         }
 
-        if (bestLength == 0) {
-            throw std::runtime_error("Unknown token at position " + sourcepos.filename + " " +  std::to_string(sourcepos.line));
+        if (bestType == INVALID || bestLength == 0) {
+            throw std::runtime_error("Unknown token at position " + sourcepos.filename() + " " +  std::to_string(sourcepos.line));
         }
-        std::string value = bestMatch.str();
+        std::string_view value = fullline.substr(pos, bestLength);
         if (bestType != WS) {
-            tokens.push_back(Token{ bestType, value, sourcepos, line_pos, start });
+            tokens.push_back(Token{ bestType, value, sourcepos, line_pos, start, decodeNumber(sourcepos, bestType, value) });
         }
 
-        for (char &c : value) {
+        for (char c : value) {
             if (c == '\n') {
                 line_pos = 1;
                 start = true;
@@ -3,17 +3,38 @@
 //
 // Lightweight, configurable tokenizer used by the assembler/parser.
 // The Tokenizer converts source text (lines or cached file segments)
-// into a sequence of `Token` instances using a list of regular expression
-// patterns associated with TOKEN_TYPE values.
+// into a sequence of `Token` instances.
 //
 // Design notes:
-//  - Patterns are stored as (TOKEN_TYPE, std::regex) pairs in the order
+//  - The default scanner is a hand-built deterministic automaton: a 256 entry
+//    start-state table picks the lexeme family from the first character and a
+//    small per-family scanner consumes the rest of the lexeme. Each line is
+//    scanned once, left to right, without copying the remaining text.
+//  - The scanner reproduces the regex rules exactly: the longest lexeme wins,
+//    ties go to the pattern listed first, `\b` boundaries are evaluated against
+//    the start of the remaining text, and spaced hex/binary (`$01 02 03`)
+//    collapses into a single number token.
+//  - Numeric literals are decoded into Token::number as they are lexed; a
+//    literal that does not fit in 32 bits is a lexer error.
+//  - Identifier shaped lexemes (mnemonics, X/Y/A, directives) are scanned as a
+//    word and then classified with the compile time perfect hash in keywords.h.
+//  - Before scanning, the lines are summarized by the SIMD front end
+//    (source_scan.h, one pass over the text of the lines being lexed) so
+//    leading blanks are skipped and a trailing comment is taken in one step.
+//  - Multi-line input can be lexed on `jobs` threads: the lines are split into
+//    contiguous chunks, each chunk is lexed into its own vector and the
+//    vectors are joined in line order, so the result (and the first error
+//    reported) is identical to a single threaded run.
+//  - The regex patterns are kept as an opt-in fallback (`useRegex`).
+//    Patterns are stored as (TOKEN_TYPE, std::regex) pairs in the order
 //    they are added. Token matching proceeds in that order so pattern
 //    ordering can affect lexical disambiguation.
-//  - Two convenience `tokenize` overloads are provided:
+//  - Three `tokenize` overloads are provided:
 //      * tokenize(const SourcePos&, const std::string&) - tokenizes a single input line.
 //      * tokenize(const std::vector<std::pair<SourcePos,std::string>>&)
 //        - tokenizes multiple lines (useful when retokenizing macro bodies).
+//      * tokenize(const SourceText&) - tokenizes a file read by the Parser
+//        straight out of its mapped buffer.
 //  - Regex compilation happens when patterns are added (constructor / add_token_pattern).
 //    Keep patterns reasonably specific to avoid performance regressions.
 //  - Tokenizer is lightweight and stateless between calls except for the configured
@@ -28,6 +49,8 @@
 #include <utility>
 #include <vector>
 #include <map>
+#include <string>
+#include <string_view>
 
 // Define default regex library if not already specified
 #if !defined(__USE_STD_REGEX__) && !defined(__USE_BOOST_REGEX__)
@@ -44,6 +67,8 @@ using RegexType = boost::regex;
 #endif 
 
 #include "common_types.h"
+#include "source_scan.h"
+#include "source_text.h"
 #include "token.h"
 
 class Tokenizer {
@@ -52,16 +77,45 @@ public:
     // Public so callers may inspect or (rarely) mutate the patterns if needed.
     std::vector<std::pair<TOKEN_TYPE, RegexType>> token_patterns;
 
+    // Use the regex patterns instead of the scanner (reference / fallback implementation).
+    bool useRegex = false;
+
+    // Threads used to tokenize multiple lines; 1 lexes on the calling thread.
+    unsigned jobs = 1;
+
     // Construct a tokenizer from an initializer list of (TOKEN_TYPE, pattern string).
     // Patterns are compiled to std::regex and stored in `token_patterns`.
     Tokenizer(std::initializer_list<std::pair<TOKEN_TYPE, std::string>> patterns);
 
     // Tokenize a single input line. `pos` provides the SourcePos used for each produced Token.
+    // The line is copied into its own retained buffer that the token values view.
     // Returns a vector of Tokens in lexical order. Implementations should include an EOL token
     // when appropriate so callers can rely on EOL to determine logical line boundaries.
     void tokenize(const SourcePos& sourcepos, const std::string& input, std::vector<Token>& tokens);
 
     // Tokenize multiple (SourcePos, line) pairs. Useful for retokenizing bodies of macros
     // or cached file segments. The returned tokens preserve the source position for each line.
+    // The lines are copied once into a single retained buffer that the token values view.
     std::vector<Token> tokenize(const std::vector<std::pair<SourcePos, std::string>>  &input);
-};
\ No newline at end of file
+
+    // Tokenize source lines held in a retained buffer (a mapped file or joined lines).
+    // The token values view that buffer; nothing is copied.
+    std::vector<Token> tokenize(const SourceText& input);
+
+private:
+    // Scanner implementation of tokenize(SourcePos, std::string, tokens).
+    // `line` is the source_scan summary of `input` (indent and comment start).
+    void scan(const SourcePos& sourcepos, std::string_view input, const SourceLine& line, std::vector<Token>& tokens) const;
+
+    // Regex implementation of tokenize(SourcePos, std::string, tokens).
+    void tokenizeRegex(const SourcePos& sourcepos, std::string_view input, std::vector<Token>& tokens) const;
+
+    // Tokenize one line of a retained buffer (the buffer holds '\n' after the line).
+    void tokenizeLine(const SourcePos& sourcepos, std::string_view input, std::vector<Token>& tokens) const;
+
+    // Tokenize input lines [first, last).
+    void tokenizeLines(const SourceText& input, size_t first, size_t last, std::vector<Token>& tokens) const;
+
+    // Split the lines into chunks and tokenize them on `jobs` threads.
+    void tokenizeParallel(const SourceText& input, std::vector<Token>& tokens) const;
+};
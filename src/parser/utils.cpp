@@ -42,7 +42,7 @@ std::string tolower(std::string& input)
 /// </summary>
 /// <param name="input"></param>
 /// <returns></returns>
-std::string sanitizeString(const std::string& input)
+std::string sanitizeString(std::string_view input)
 {
     std::vector<uint8_t>chars;
     sanitizeString(input, chars);
@@ -53,7 +53,7 @@ std::string sanitizeString(const std::string& input)
     return out;
 }
 
-void sanitizeString(const std::string& input, std::vector<uint8_t>& output)
+void sanitizeString(std::string_view input, std::vector<uint8_t>& output)
 {
     output.clear();
     size_t len = input.length();
@@ -79,7 +79,7 @@ void sanitizeString(const std::string& input, std::vector<uint8_t>& output)
                 case 'x':
                 {
                     if (i + 2 < len - 1 && std::isxdigit(input[i + 1]) && std::isxdigit(input[i + 2])) {
-                        std::string hex = input.substr(i + 1, 2);
+                        std::string hex(input.substr(i + 1, 2));
                         output.push_back(static_cast<uint8_t>(std::stoi(hex, nullptr, 16)));
                         i += 2;
                     }
@@ -96,22 +96,6 @@ void sanitizeString(const std::string& input, std::vector<uint8_t>& output)
     }
 }
 
-/// <summary>
-/// join segments of a number
-/// </summary>
-/// <param name="num"></param>
-/// <returns></returns>
-std::string join_segments(std::string num)
-{
-    std::string out;
-    for (auto& ch : num) {
-        if (!std::isspace(ch)) {
-            out += ch;
-        }
-    }
-    return out;
-}
-
 void extractworddata(std::shared_ptr<ASTNode>& node, std::vector<uint16_t>& data)
 {
     for (auto& child : node->children) {
@@ -149,6 +133,11 @@ void extractdata(std::shared_ptr<ASTNode>& node, std::vector<uint16_t>& data)
 // helper for calcoutputsize for .byte or .word directive
 static void processdata(int& sz, std::shared_ptr<ASTNode>& node, bool word)
 {
+    if (node->type == DataBytes) {
+        sz += static_cast<int>(node->data.size());
+        return;
+    }
+
     for (auto& child : node->children) {
         if (std::holds_alternative<std::shared_ptr<ASTNode>>(child)) {
             auto& childnode = std::get<std::shared_ptr<ASTNode>>(child);
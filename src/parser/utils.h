@@ -1,6 +1,7 @@
 // written by Paul Baxter
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 
 /*
@@ -24,7 +25,7 @@
  Returns:
    - sanitized textual representation.
 */
-extern std::string sanitizeString(const std::string& input);
+extern std::string sanitizeString(std::string_view input);
 
 /*
  Variant of sanitizeString that converts the input into a sequence of raw
@@ -34,19 +35,7 @@ extern std::string sanitizeString(const std::string& input);
    - input: source text to sanitize/parse.
    - output: byte vector that will receive the parsed bytes.
 */
-extern void sanitizeString(const std::string& input, std::vector<uint8_t>& output);
-
-/*
- Normalize or join numeric segments inside a textual numeric expression.
- Many assemblers allow numbers to be written in segmented forms (for
- example with separators). This helper returns a canonical / joined
- representation suitable for numeric parsing.
- Parameters:
-   - num: numeric string possibly containing separators or segments.
- Returns:
-   - normalized/joined numeric string.
-*/
-extern std::string join_segments(std::string num);
+extern void sanitizeString(std::string_view input, std::vector<uint8_t>& output);
 
 /*
  Extract byte-oriented data values from an AST node into a numeric vector.
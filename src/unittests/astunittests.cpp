@@ -1,6 +1,7 @@
 // Written by Paul Baxter
 #include <gtest/gtest.h>
 #include <string>
+#include <tuple>
 
 #include <sstream>
 #include <fstream>
@@ -9,7 +10,9 @@
 #include <map>
 #include <vector>
 #include <chrono>
+#include <iomanip>
 #include <cmath>
+#include <cstdlib>
 #include <filesystem>
 
 #include "ANSI_esc.h"
@@ -18,6 +21,8 @@
 #include "expressionparser.h"
 #include "grammar_rule.h"
 #include "parser.h"
+#include "source_buffer.h"
+#include "tokenizer.h"
 
 #pragma warning(disable:4996)
 
@@ -47,9 +52,9 @@ namespace parser_unit_test
     // Short aliases
     auto pos = [](const std::string file, size_t line) { return SourcePos{ file, line }; };
 
-    inline auto tok = [](TOKEN_TYPE type, std::string txt, SourcePos pos, size_t val = 0, bool start = true)
+    inline auto tok = [](TOKEN_TYPE type, std::string_view txt, SourcePos pos, size_t val = 0, bool start = true)
         {
-            return Token{ type, std::move(txt), pos, val, start };
+            return Token{ type, retainText(std::string(txt)), pos, val, start };
         };
 
     inline auto node = [](RULE_TYPE type, int val, SourcePos pos, auto... children)
@@ -3162,4 +3167,557 @@ namespace parser_unit_test
             FAIL();
         }
     }
+
+    TEST(ast_unit_test, include_cache)
+    {
+        std::string file = fs::absolute(fs::path(startdir + "lda.asm")).lexically_normal().string();
+        Parser p(parserDict);
+
+        auto& first = p.includeTokens(file);
+        auto& second = p.includeTokens(file);
+        EXPECT_EQ(&first, &second);
+        EXPECT_EQ(1u, p.includeCacheMisses);
+        EXPECT_EQ(1u, p.includeCacheHits);
+
+        ASSERT_FALSE(first.empty());
+        EXPECT_EQ(EOL, first.type(0));
+        EXPECT_EQ(tokenizer.tokenize(p.readfile(file)).size() + 1, first.size());
+        EXPECT_EQ(&p.readfile(file), &p.readfile(file));
+    }
+
+    TEST(ast_unit_test, parse_memo)
+    {
+        std::string file = fs::absolute(fs::path(startdir + "symboltest.asm")).lexically_normal().string();
+
+        ParserOptions plain;
+        plain.files.push_back(file);
+        plain.memoize = false;
+        ExpressionParser expected(plain);
+        auto expectedAst = expected.parse();
+        EXPECT_EQ(0u, expected.parser->memoHits);
+
+        ParserOptions options;
+        options.files.push_back(file);
+        options.memoize = true;
+        ExpressionParser memoized(options);
+        auto ast = memoized.parse();
+        compareAST(ast, expectedAst);
+        EXPECT_GT(memoized.parser->memoHits, 0u);
+        EXPECT_GT(memoized.parser->memoTokensSaved, 0u);
+    }
+
+    TEST(ast_unit_test, first_sets)
+    {
+        auto number = ruleFirst(Number);
+        ASSERT_NE(nullptr, number);
+        EXPECT_FALSE(number->first.nullable);
+        EXPECT_TRUE(number->first.admits(DECNUM));
+        EXPECT_TRUE(number->first.admits(CHAR));
+        EXPECT_FALSE(number->first.admits(SYM));
+        EXPECT_FALSE(number->first.admits(TOKEN_TYPE::LAST));
+
+        // Factor reaches through Number, SymbolRef and ( Expr )
+        auto factor = ruleFirst(Factor);
+        ASSERT_NE(nullptr, factor);
+        EXPECT_TRUE(factor->first.admits(HEXNUM));
+        EXPECT_TRUE(factor->first.admits(SYM));
+        EXPECT_TRUE(factor->first.admits(LPAREN));
+        EXPECT_FALSE(factor->first.admits(EOL));
+
+        // only the ( Expr ) alternative starts with (
+        size_t candidates = 0;
+        for (auto& alt : factor->productions) {
+            if (alt.admits(LPAREN)) ++candidates;
+        }
+        EXPECT_EQ(1u, candidates);
+
+        EXPECT_EQ(nullptr, ruleFirst(DECNUM));
+    }
+
+    TEST(ast_unit_test, expression_precedence)
+    {
+        const std::vector<std::pair<std::string, int32_t>> cases = {
+            { "1 + 2 * 3", 7 },
+            { "10 - 4 - 3", 3 },
+            { "1 << 2 + 1", 8 },
+            { "6 & 3 == 3", 0 },
+            { "1 | 2 & 3", 3 },
+            { "2 < 3 && 0 || 4 >= 4", 1 },
+            { "~1 * 2", 0x1fc },
+            { "<$1234 + 1", 0x35 },
+            { "(1 + 2) * 3", 9 },
+        };
+
+        for (auto& [text, value] : cases) {
+            Parser p(parserDict);
+            std::vector<std::pair<SourcePos, std::string>> lines = { { SourcePos("expr", 1), text } };
+            p.tokens = tokenizer.tokenize(lines);
+            p.current_pos = 0;
+
+            auto ast = p.parse_rule(Expr);
+            ASSERT_NE(nullptr, ast) << text;
+            EXPECT_EQ(Expr, ast->type) << text;
+            EXPECT_EQ(value, ast->value) << text;
+            EXPECT_EQ(EOL, p.tokens.type(p.current_pos)) << text;
+        }
+    }
+
+    TEST(ast_unit_test, operand_modes)
+    {
+        const std::vector<std::tuple<std::string, int64_t, int32_t>> cases = {
+            { "nop", Op_Implied, 0xea },
+            { "asl a", Op_Accumulator, 0x0a },
+            { "lda #$12", Op_Immediate, 0xa9 },
+            { "lda $12", Op_ZeroPage, 0xa5 },
+            { "lda $1234", Op_Absolute, 0xad },
+            { "lda $12,x", Op_ZeroPageX, 0xb5 },
+            { "lda $1234,y", Op_AbsoluteY, 0xb9 },
+            { "lda ($12,x)", Op_IndirectX, 0xa1 },
+            { "lda ($12),y", Op_IndirectY, 0xb1 },
+            { "jmp ($1234)", Op_Indirect, 0x6c },
+        };
+
+        for (auto& [text, mode, opcode] : cases) {
+            Parser p(parserDict);
+            p.pass = 2;
+            std::vector<std::pair<SourcePos, std::string>> lines = { { SourcePos("modes", 1), "    " + text } };
+            p.tokens = tokenizer.tokenize(lines);
+            p.current_pos = 0;
+
+            auto ast = p.parse_rule(Op_Instruction);
+            ASSERT_NE(nullptr, ast) << text;
+            ASSERT_EQ(1u, ast->children.size()) << text;
+            auto& node = std::get<std::shared_ptr<ASTNode>>(ast->children[0]);
+            EXPECT_EQ(mode, node->type) << text;
+            EXPECT_EQ(opcode, ast->value) << text;
+            EXPECT_EQ(EOL, p.tokens.type(p.current_pos)) << text;
+        }
+
+        Parser p(parserDict);
+        std::vector<std::pair<SourcePos, std::string>> lines = { { SourcePos("modes", 1), "    lda a" } };
+        p.tokens = tokenizer.tokenize(lines);
+        p.current_pos = 0;
+        EXPECT_ANY_THROW(p.parse_rule(Op_Instruction));
+    }
+
+    TEST(ast_unit_test, rule_matches)
+    {
+        RuleMatches matches;
+        EXPECT_EQ(0, matches.count(3, Expr));
+
+        matches.record(3, Expr);
+        matches.record(3, Expr);
+        matches.record(3, Factor);
+        EXPECT_EQ(2, matches.count(3, Expr));
+        EXPECT_EQ(1, matches.count(3, Factor));
+        EXPECT_EQ(0, matches.count(4, Expr));
+
+        // enough pairs to grow the table several times
+        for (size_t pos = 0; pos < 10000; ++pos) {
+            matches.record(pos, Line);
+        }
+        EXPECT_EQ(10002u, matches.size());
+        EXPECT_EQ(2, matches.count(3, Expr));
+        EXPECT_EQ(1, matches.count(9999, Line));
+
+        matches.clear();
+        EXPECT_EQ(0u, matches.size());
+        EXPECT_EQ(0, matches.count(3, Expr));
+
+        // counts belong to one parser
+        Parser a(parserDict), b(parserDict);
+        a.ruleMatches.record(0, Expr);
+        EXPECT_EQ(1, a.ruleMatches.count(0, Expr));
+        EXPECT_EQ(0, b.ruleMatches.count(0, Expr));
+    }
+
+    TEST(ast_unit_test, parse_state_checkpoint)
+    {
+        Parser p(parserDict);
+        std::vector<std::pair<SourcePos, std::string>> lines = {
+            { SourcePos("state", 1), "    lda #1" },
+            { SourcePos("state", 2), "    sta $10" },
+            { SourcePos("state", 3), "    rts" },
+        };
+        p.tokens = tokenizer.tokenize(lines);
+        auto original = p.tokens.slice(0, p.tokens.size());
+        auto same = [&p](const std::vector<Token>& expected)
+            {
+                auto now = p.tokens.slice(0, p.tokens.size());
+                if (now.size() != expected.size()) return false;
+                for (size_t i = 0; i < now.size(); ++i) {
+                    if (now[i].type != expected[i].type || now[i].value != expected[i].value || now[i].pos != expected[i].pos)
+                        return false;
+                }
+                return true;
+            };
+
+        p.current_pos = 4;
+        p.PC = 0x1000;
+        p.pushParseState(p.getCurrentState());
+
+        // edits after the checkpoint: drop line 2, append a line
+        p.RemoveLineRange(5, 5);
+        p.InsertTokens(static_cast<int>(p.tokens.size()), tokenizer.tokenize({ { SourcePos("state", 4), "    nop" } }));
+        auto inner = p.getCurrentState();
+        p.RemoveCurrentLine();
+        p.PC = 0x2000;
+        EXPECT_FALSE(same(original));
+
+        p.setCurrentState(inner);
+        EXPECT_EQ(0x1000, p.PC);
+        EXPECT_FALSE(same(original));
+
+        p.setCurrentState(p.popParseState());
+        EXPECT_TRUE(same(original));
+        EXPECT_EQ(4u, p.current_pos);
+        EXPECT_EQ(0x1000, p.PC);
+    }
+
+    TEST(ast_unit_test, flat_data_list)
+    {
+        // a data table line far longer than a recursive list production
+        // could nest on the stack
+        const int values = 100000;
+        std::string line = "    .byte \"AB\"";
+        for (int i = 0; i < values; ++i) {
+            line += ", " + std::to_string(i & 0xFF);
+        }
+
+        Parser p(parserDict);
+        p.pass = 1;
+        p.tokens = tokenizer.tokenize({ { SourcePos("table", 1), line } });
+        auto node = p.parse_rule(ByteDirective);
+        ASSERT_NE(nullptr, node);
+        EXPECT_EQ(EOL, p.tokens.type(p.current_pos));
+
+        auto& list = std::get<std::shared_ptr<ASTNode>>(node->children[1]);
+        ASSERT_EQ(ExprList, list->type);
+        ASSERT_EQ(values + 2u, list->children.size());
+        for (size_t i = 0; i < list->children.size(); ++i) {
+            auto& item = std::get<std::shared_ptr<ASTNode>>(list->children[i]);
+            ASSERT_EQ(Expr, item->type) << i;
+            int expected = i == 0 ? 'A' : i == 1 ? 'B' : static_cast<int>((i - 2) & 0xFF);
+            ASSERT_EQ(expected, item->value) << i;
+        }
+
+        // a trailing comma is left for the line to reject
+        p.tokens = tokenizer.tokenize({ { SourcePos("table", 1), "    .byte 1, 2," } });
+        p.current_pos = 0;
+        node = p.parse_rule(ByteDirective);
+        ASSERT_NE(nullptr, node);
+        EXPECT_EQ(COMMA, p.tokens.type(p.current_pos));
+        EXPECT_EQ(2u, std::get<std::shared_ptr<ASTNode>>(node->children[1])->children.size());
+    }
+
+    TEST(ast_unit_test, data_line_fast_path)
+    {
+        const std::vector<std::string> source = {
+            "    .byte 1, $FF, 'A', \"BC\" ; table",
+            "    .word $1234, 2",
+            "    .byte 1, 2 + 3",
+            "    .byte 256",
+            "tbl .byte 7",
+        };
+        std::vector<std::pair<SourcePos, std::string>> lines;
+        for (auto& line : source) {
+            lines.push_back({ SourcePos("data", lines.size() + 1), line });
+        }
+
+        Parser p(parserDict);
+        p.pass = 1;
+        p.tokens = tokenizer.tokenize(lines);
+        const int org = p.PC;
+
+        auto directive = [](const std::shared_ptr<ASTNode>& line)
+            {
+                auto& statement = std::get<std::shared_ptr<ASTNode>>(line->children[0]);
+                return std::get<std::shared_ptr<ASTNode>>(statement->children[0]);
+            };
+        auto packed = [&](const std::shared_ptr<ASTNode>& line)
+            {
+                return std::get<std::shared_ptr<ASTNode>>(directive(line)->children[1]);
+            };
+
+        // literals and strings are packed without the grammar
+        auto line = p.parse_data_line();
+        ASSERT_NE(nullptr, line);
+        EXPECT_EQ(Line, line->type);
+        EXPECT_EQ(1, line->value);
+        auto data = packed(line);
+        ASSERT_EQ(DataBytes, data->type);
+        EXPECT_EQ(ByteDirective, directive(line)->type);
+        EXPECT_EQ(0, data->value);
+        EXPECT_EQ((std::vector<uint8_t>{ 1, 0xFF, 'A', 'B', 'C' }), data->data);
+        EXPECT_EQ(org + 5, p.PC);
+
+        line = p.parse_data_line();
+        ASSERT_NE(nullptr, line);
+        data = packed(line);
+        EXPECT_EQ(WordDirective, directive(line)->type);
+        EXPECT_EQ(0, data->value);
+        EXPECT_EQ((std::vector<uint8_t>{ 0x34, 0x12, 2, 0 }), data->data);
+        EXPECT_EQ(org + 9, p.PC);
+
+        // an expression, a value that does not fit or a label needs the grammar
+        for (int expectedPC : { 11, 12, 13 }) {
+            size_t start = p.current_pos;
+            EXPECT_EQ(nullptr, p.parse_data_line());
+            EXPECT_EQ(start, p.current_pos);
+            line = p.parse_rule(Line);
+            ASSERT_NE(nullptr, line);
+            EXPECT_EQ(org + expectedPC, p.PC);
+        }
+        EXPECT_EQ(p.tokens.size() - 1, p.current_pos);
+        EXPECT_EQ(EOL, p.tokens.type(p.current_pos));
+    }
+
+    TEST(ast_unit_test, line_replay)
+    {
+        const std::vector<std::string> source = {
+            "start lda #1",
+            "    sta fwd",
+            "    .byte 1, 2 + 3",
+            "fwd .word start",
+            "    nop",
+        };
+        std::vector<std::pair<SourcePos, std::string>> lines;
+        for (auto& line : source) {
+            lines.push_back({ SourcePos("replay", lines.size() + 1), line });
+        }
+        const TokenStore tokens = tokenizer.tokenize(lines);
+
+        Parser p(parserDict);
+        auto pass = [&]()
+            {
+                p.tokens = tokens;
+                std::stringstream ss;
+                p.Pass()->print(ss, false);
+                return std::make_pair(ss.str(), p.PC);
+            };
+
+        // the first pass parses every line, the forward reference keeps
+        // "sta fwd" from being recorded until it is resolved (the tokenizer
+        // ends the source with an empty line, replayed as well)
+        auto first = pass();
+        EXPECT_EQ(0u, p.linesReplayed);
+
+        auto second = pass();
+        EXPECT_EQ(5u, p.linesReplayed);
+        EXPECT_EQ(first.second, second.second);
+
+        auto third = pass();
+        EXPECT_EQ(11u, p.linesReplayed);
+        EXPECT_EQ(second, third);
+    }
+
+    TEST(ast_unit_test, collect_errors)
+    {
+        const std::vector<std::string> source = {
+            "    lda #$1234",
+            "    nop",
+            "    .byte 1 +",
+            "    unknownmac 1",
+            "    rts",
+        };
+        std::vector<std::pair<SourcePos, std::string>> lines;
+        for (auto& line : source) {
+            lines.push_back({ SourcePos("errors", lines.size() + 1), line });
+        }
+        const TokenStore tokens = tokenizer.tokenize(lines);
+
+        // the first error ends the pass by default
+        Parser p(parserDict);
+        p.tokens = tokens;
+        EXPECT_THROW(p.Pass(), ParseError);
+
+        // collected, every line after an error is parsed
+        Parser c(parserDict);
+        c.maxErrors = 10;
+        c.tokens = tokens;
+        const int org = c.PC;
+        ASSERT_NO_THROW(c.Pass());
+        ASSERT_EQ(3u, c.diagnostics.size());
+        EXPECT_EQ(DiagCode::Range, c.diagnostics[0].code);
+        EXPECT_EQ(1u, c.diagnostics[0].token.pos.line);
+        EXPECT_EQ(DiagCode::Syntax, c.diagnostics[1].code);
+        EXPECT_EQ(3u, c.diagnostics[1].token.pos.line);
+        EXPECT_EQ(DiagCode::Macro, c.diagnostics[2].code);
+        EXPECT_EQ(4u, c.diagnostics[2].token.pos.line);
+        EXPECT_EQ(org + 2, c.PC);
+
+        // up to maxErrors
+        Parser two(parserDict);
+        two.maxErrors = 2;
+        two.tokens = tokens;
+        two.Pass();
+        EXPECT_EQ(2u, two.diagnostics.size());
+    }
+
+    TEST(ast_unit_test, node_pool_reuse)
+    {
+        const std::vector<std::string> source = {
+            "start lda #1 + 2",
+            "    sta fwd,x",
+            "    .byte 1, 2 + 3",
+            "fwd .word start",
+        };
+        std::vector<std::pair<SourcePos, std::string>> lines;
+        for (int copy = 0; copy < 200; ++copy) {
+            for (auto& line : source) {
+                // labels are unique per copy
+                std::string text = line;
+                for (std::string_view name : { "start", "fwd" }) {
+                    for (size_t at; (at = text.find(name)) != std::string::npos;) {
+                        text.replace(at, name.size(), std::string(1, name[0]) + std::to_string(copy));
+                    }
+                }
+                lines.push_back({ SourcePos("pool", lines.size() + 1), text });
+            }
+        }
+        const TokenStore tokens = tokenizer.tokenize(lines);
+
+        // the tree of a pass is released into the pool when the next pass
+        // replaces it (two trees are alive while a pass runs), so passes
+        // after the second take no new chunks
+        Parser p(parserDict);
+        std::shared_ptr<ASTNode> ast;
+        for (int pass = 0; pass < 2; ++pass) {
+            p.tokens = tokens;
+            ast = p.Pass();
+        }
+        const size_t chunks = nodePool().chunkCount();
+        const size_t used = nodePool().slotsUsed();
+        for (int pass = 0; pass < 3; ++pass) {
+            p.tokens = tokens;
+            ast = p.Pass();
+            EXPECT_EQ(chunks, nodePool().chunkCount());
+            EXPECT_LE(nodePool().slotsUsed(), used);
+        }
+
+        // a node comes back to the pool when its last reference is dropped
+        const size_t before = nodePool().slotsUsed();
+        {
+            auto node = makeNode(Line);
+            EXPECT_EQ(before + 1, nodePool().slotsUsed());
+        }
+        EXPECT_EQ(before, nodePool().slotsUsed());
+    }
+
+    TEST(ast_unit_test, expand_macro_parameters)
+    {
+        auto param = [](std::string_view text)
+            {
+                Token tok;
+                tok.type = MACRO_PARAM;
+                tok.value = text;
+                return tok;
+            };
+
+        // body: Line [ Statement [ \1 ] , \2 ]
+        auto statement = makeNode(Statement);
+        statement->add_child(param("\\1"));
+        auto line = makeNode(Line);
+        line->add_child(statement);
+        line->add_child(param("\\2"));
+        auto body = makeNode(LineList);
+        body->add_child(line);
+
+        Parser p(parserDict);
+        auto expanded = p.expandMacro("m", { "$12", "x" }, body);
+
+        auto& newLine = std::get<std::shared_ptr<ASTNode>>(expanded->children[0]);
+        auto& newStatement = std::get<std::shared_ptr<ASTNode>>(newLine->children[0]);
+        EXPECT_EQ("$12", std::get<Token>(newStatement->children[0]).value);
+        EXPECT_EQ("x", std::get<Token>(newLine->children[1]).value);
+
+        // the definition keeps its parameters
+        EXPECT_EQ("\\1", std::get<Token>(statement->children[0]).value);
+        EXPECT_EQ("\\2", std::get<Token>(line->children[1]).value);
+
+        EXPECT_THROW(p.expandMacro("m", { "$12" }, body), ParseError);
+    }
+
+    // instruction and expression lines of the parse_rule tests, `copies`
+    // times over
+    static std::vector<std::pair<SourcePos, std::string>> parseRuleLines(int copies)
+    {
+        const std::vector<std::string> source = {
+            "    lda #$12",
+            "    sta $1234,x",
+            "    lda ($12),y",
+            "    .byte 1, 2 + 3 * 4, (5 << 2) | 1",
+            "    .word $1000 + 3 * 4 - 2",
+            "    adc $12",
+            "    nop",
+        };
+        std::vector<std::pair<SourcePos, std::string>> lines;
+        for (int i = 0; i < copies; ++i) {
+            for (auto& line : source) {
+                lines.push_back({ SourcePos("bench", lines.size() + 1), line });
+            }
+        }
+        return lines;
+    }
+
+    TEST(ast_unit_test, parse_rule_lines)
+    {
+        // each line parses to one Line node, and parsing the same tokens
+        // again makes the same parse_rule calls
+        auto lines = parseRuleLines(2);
+        Parser p(parserDict);
+        p.pass = 1;
+        p.tokens = tokenizer.tokenize(lines);
+
+        size_t calls = 0;
+        for (int run = 0; run < 2; ++run) {
+            p.current_pos = 0;
+            p.ruleCalls = 0;
+            size_t parsedLines = 0;
+            while (p.current_pos < p.tokens.size()) {
+                auto line = p.parse_rule(Line);
+                ASSERT_NE(nullptr, line);
+                EXPECT_EQ(Line, line->type);
+                ++parsedLines;
+            }
+            EXPECT_EQ(lines.size() + 1, parsedLines);      // and the final EOL the tokenizer adds
+            ASSERT_GT(p.ruleCalls, 0u);
+            if (run == 0)
+                calls = p.ruleCalls;
+            EXPECT_EQ(calls, p.ruleCalls);
+        }
+    }
+
+    TEST(ast_unit_test, parse_rule_benchmark)
+    {
+        // reports the average cost of a parse_rule call; timing only, so it
+        // runs when PASM_BENCHMARK is set
+        if (!std::getenv("PASM_BENCHMARK")) {
+            GTEST_SKIP() << "set PASM_BENCHMARK to run";
+        }
+
+        auto lines = parseRuleLines(200);
+        Parser p(parserDict);
+        p.pass = 1;
+        p.tokens = tokenizer.tokenize(lines);
+
+        size_t parsedLines = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int run = 0; run < 20; ++run) {
+            p.current_pos = 0;
+            while (p.current_pos < p.tokens.size()) {
+                auto line = p.parse_rule(Line);
+                ASSERT_NE(nullptr, line);
+                ++parsedLines;
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+        EXPECT_LE(20 * lines.size(), parsedLines);
+        ASSERT_GT(p.ruleCalls, 0u);
+        std::cout << "parse_rule: " << p.ruleCalls << " calls, " <<
+            std::fixed << std::setprecision(1) << ns / p.ruleCalls << " ns per call, " <<
+            ns / parsedLines << " ns per line\n";
+    }
 }
\ No newline at end of file
@@ -18,6 +18,11 @@
 #include "expressionparser.h"
 #include "grammar_rule.h"
 #include "parser.h"
+#include "source_scan.h"
+#include "source_buffer.h"
+#include "source_text.h"
+#include "token_cache.h"
+#include "token_store.h"
 #include "tokenizer.h"
 #include "opcodedict.h"
 #include "utils.h"
@@ -46,7 +51,7 @@ void CompareTokens(std::vector<Token>& expected, std::vector<Token>& actual)
         EXPECT_EQ(e.type, a.type);
         EXPECT_EQ(e.value, a.value);
         EXPECT_EQ(e.start, a.start);
-        EXPECT_EQ(e.pos.filename, a.pos.filename);
+        EXPECT_EQ(e.pos.filename(), a.pos.filename());
         EXPECT_EQ(e.pos.line, a.pos.line);        
     }
 }
@@ -4154,6 +4159,455 @@ namespace parser_unit_test
         }
     }
 
+    TEST(tok_unit_test, scanner_matches_regex)
+    {
+        for (auto const& dir_entry : std::filesystem::directory_iterator{ startdir }) {
+            auto& path = dir_entry.path();
+            if (path.extension() != ".asm")
+                continue;
+
+            auto file = path.string();
+            std::ifstream f(file);
+            std::vector<std::pair<SourcePos, std::string>> lines;
+            std::string line;
+            int l = 0;
+            while (std::getline(f, line)) {
+                lines.push_back({ SourcePos(file, ++l), line });
+            }
+            lines.push_back({ SourcePos(file, ++l), "o17 0o17 017 &17 %01 10 $01 02 03 .includex .print  off '\\'' \"a\\\"b\" @loc \\1" });
+
+            tokenizer.useRegex = true;
+            auto expected = tokenizer.tokenize(lines);
+            tokenizer.useRegex = false;
+            auto actual = tokenizer.tokenize(lines);
+            CompareTokens(expected, actual);
+        }
+    }
+
+    TEST(tok_unit_test, source_scan_levels)
+    {
+        std::string text;
+        for (auto i = 0; i < 200; ++i) {
+            text += std::string(i % 13, i % 2 ? ' ' : '\t') + "lda #$" + std::to_string(i) +
+                (i % 3 ? " ; comment " : " '; not a comment'") + std::string(i % 70, 'x') + "\n";
+            if (i % 17 == 0)
+                text += "\n";
+        }
+        text += "last line without newline";
+
+        std::vector<std::string> expected;
+        std::istringstream in(text);
+        std::string line;
+        while (std::getline(in, line)) {
+            expected.push_back(line);
+        }
+
+        for (auto level : { ScanLevel::Scalar, ScanLevel::SSE2, ScanLevel::AVX2 }) {
+            setSourceScanLevel(level);
+            auto lines = scanSource(text);
+            ASSERT_EQ(expected.size(), lines.size());
+            for (size_t i = 0; i < lines.size(); ++i) {
+                auto actual = text.substr(lines[i].offset, lines[i].length);
+                EXPECT_EQ(expected[i], actual);
+                EXPECT_EQ(actual.find_first_not_of(" \t") == std::string::npos ? actual.size() : actual.find_first_not_of(" \t"), lines[i].indent);
+                auto semi = actual.find(';');
+                auto quote = actual.find_first_of("'\"");
+                EXPECT_EQ(quote < semi ? SourceLine::npos : semi, lines[i].comment);
+            }
+        }
+        setSourceScanLevel(ScanLevel::AVX2);
+    }
+
+    TEST(tok_unit_test, token_cache)
+    {
+        std::string file = fs::absolute(fs::path(startdir + "lda.asm")).lexically_normal().string();
+        SourceText lines(file, retainSourceFile(file));
+
+        auto dir = fs::temp_directory_path() / "pasm_token_cache_test";
+        fs::remove_all(dir);
+
+        TokenCache cache;
+        cache.directory = dir.string();
+        auto expected = tokenizer.tokenize(lines);
+
+        auto cold = cache.tokenize(lines);
+        CompareTokens(expected, cold);
+        auto warm = cache.tokenize(lines);
+        CompareTokens(expected, warm);
+        EXPECT_EQ(1u, cache.hits);
+        EXPECT_EQ(1u, cache.misses);
+
+        // options are part of the key
+        cache.options = TOKEN_CACHE_65C02;
+        auto other = cache.tokenize(lines);
+        CompareTokens(expected, other);
+        EXPECT_EQ(2u, cache.misses);
+
+        // entries written by another format version are ignored and replaced
+        for (auto const& entry : fs::directory_iterator{ dir }) {
+            std::fstream io(entry.path(), std::ios::in | std::ios::out | std::ios::binary);
+            uint32_t version = 0;
+            io.seekp(8);
+            io.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        }
+        // and neither they nor the entries used are kept in memory
+        const size_t bytes = retainedBufferBytes();
+        auto stale = cache.tokenize(lines);
+        CompareTokens(expected, stale);
+        EXPECT_EQ(3u, cache.misses);
+        auto rewritten = cache.tokenize(lines);
+        CompareTokens(expected, rewritten);
+        EXPECT_EQ(2u, cache.hits);
+        EXPECT_EQ(bytes, retainedBufferBytes());
+
+        fs::remove_all(dir);
+    }
+
+    TEST(tok_unit_test, token_store)
+    {
+        std::string file = fs::absolute(fs::path(startdir + "lda.asm")).lexically_normal().string();
+        std::ifstream f(file);
+        std::vector<std::pair<SourcePos, std::string>> lines;
+        std::string line;
+        int l = 0;
+        while (std::getline(f, line)) {
+            lines.push_back({ SourcePos(file, ++l), line });
+        }
+        auto expected = tokenizer.tokenize(lines);
+
+        TokenStore store(expected);
+        ASSERT_EQ(expected.size(), store.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(expected[i].type, store.type(i));
+            EXPECT_EQ(expected[i].start, store.start(i));
+        }
+        auto actual = store.slice(0, store.size());
+        CompareTokens(expected, actual);
+
+        // splice a token from another buffer into the middle and take it out again
+        Token param = expected[1];
+        param.value = retainText("$1234");
+        store.insert(1, std::vector<Token>{ param });
+        EXPECT_EQ(expected.size() + 1, store.size());
+        EXPECT_EQ("$1234", store.value(1));
+        EXPECT_EQ(expected[1].pos, store.pos(1));
+        EXPECT_EQ(expected[1].value, store.value(2));
+
+        store.erase(1, 2);
+        actual = store.slice(0, store.size());
+        CompareTokens(expected, actual);
+    }
+
+    TEST(tok_unit_test, token_store_splices)
+    {
+        std::string file = fs::absolute(fs::path(startdir + "lda.asm")).lexically_normal().string();
+        std::ifstream f(file);
+        std::vector<std::pair<SourcePos, std::string>> lines;
+        std::string line;
+        int l = 0;
+        while (std::getline(f, line)) {
+            lines.push_back({ SourcePos(file, ++l), line });
+        }
+        auto source = tokenizer.tokenize(lines);
+        ASSERT_GT(source.size(), 8u);
+
+        // random splices applied to the store and to a plain vector
+        std::vector<Token> expected = source;
+        TokenStore store(source);
+        uint32_t seed = 12345;
+        auto next = [&seed](size_t n) { seed = seed * 1103515245 + 12345; return n ? (seed >> 8) % n : 0; };
+
+        for (int step = 0; step < 500; ++step) {
+            size_t size = expected.size();
+            switch (next(4)) {
+                case 0: {
+                    // insert a run of tokens taken from the store itself
+                    size_t first = next(size);
+                    size_t last = first + next(std::min<size_t>(size - first, 16) + 1);
+                    size_t at = next(size + 1);
+                    auto run = store.range(first, last);
+                    std::vector<Token> copy(expected.begin() + first, expected.begin() + last);
+                    store.insert(at, run);
+                    expected.insert(expected.begin() + at, copy.begin(), copy.end());
+                    break;
+                }
+                case 1: {
+                    size_t first = next(size);
+                    size_t last = first + next(std::min<size_t>(size - first, 8) + 1);
+                    if (expected.size() - (last - first) < 8) break;
+                    store.erase(first, last);
+                    expected.erase(expected.begin() + first, expected.begin() + last);
+                    break;
+                }
+                case 2: {
+                    auto& tok = source[next(source.size())];
+                    size_t at = next(size + 1);
+                    store.insert(at, std::vector<Token>{ tok });
+                    expected.insert(expected.begin() + at, tok);
+                    break;
+                }
+                default:
+                    store.push_back(source[step % source.size()]);
+                    expected.push_back(source[step % source.size()]);
+                    break;
+            }
+
+            ASSERT_EQ(expected.size(), store.size()) << "step " << step;
+            size_t probe = next(expected.size());
+            EXPECT_EQ(expected[probe].type, store.type(probe)) << "step " << step;
+            EXPECT_EQ(expected[probe].value, store.value(probe)) << "step " << step;
+
+            // EOL index against a scan of the vector
+            size_t next = TokenStore::npos, prev = TokenStore::npos;
+            for (size_t i = probe; i < expected.size() && next == TokenStore::npos; ++i) {
+                if (expected[i].type == EOL) next = i;
+            }
+            for (size_t i = probe; i > 0 && prev == TokenStore::npos; --i) {
+                if (expected[i - 1].type == EOL) prev = i - 1;
+            }
+            EXPECT_EQ(next, store.nextEOL(probe)) << "step " << step;
+            EXPECT_EQ(prev, store.prevEOL(probe)) << "step " << step;
+        }
+
+        auto actual = store.slice(0, store.size());
+        CompareTokens(expected, actual);
+        auto copy = store.range(0, store.size());
+        actual = copy.slice(0, copy.size());
+        CompareTokens(expected, actual);
+        for (size_t i = 0; i <= expected.size(); ++i) {
+            ASSERT_EQ(store.nextEOL(i), copy.nextEOL(i)) << i;
+            ASSERT_EQ(store.prevEOL(i), copy.prevEOL(i)) << i;
+        }
+    }
+
+    TEST(tok_unit_test, token_store_directive_links)
+    {
+        std::vector<std::pair<SourcePos, std::string>> lines = {
+            { SourcePos("links.asm", 1), " .if 1" },
+            { SourcePos("links.asm", 2), "  .ifdef x" },
+            { SourcePos("links.asm", 3), "  .else" },
+            { SourcePos("links.asm", 4), "   .do" },
+            { SourcePos("links.asm", 5), "   .while 1" },
+            { SourcePos("links.asm", 6), "  .endif" },
+            { SourcePos("links.asm", 7), " .else" },
+            { SourcePos("links.asm", 8), "  .while 2" },
+            { SourcePos("links.asm", 9), "  .wend" },
+            { SourcePos("links.asm", 10), " .endif" },
+            { SourcePos("links.asm", 11), "m .macro" },
+            { SourcePos("links.asm", 12), " .endm" },
+        };
+        auto tokens = tokenizer.tokenize(lines);
+        TokenStore store(tokens);
+
+        // index of the first token of each line
+        std::vector<size_t> line = { 0 };
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (tokens[i].type == EOL) line.push_back(i + 1);
+        }
+        auto at = [&](int l) { return line[l - 1] + (l == 11 ? 1 : 0); };
+
+        EXPECT_EQ(at(7), store.partner(at(1)));
+        EXPECT_EQ(at(10), store.partner(at(7)));
+        EXPECT_EQ(at(1), store.partner(at(10)));
+        EXPECT_EQ(at(3), store.partner(at(2)));
+        EXPECT_EQ(at(6), store.partner(at(3)));
+        EXPECT_EQ(at(2), store.partner(at(6)));
+        EXPECT_EQ(at(5), store.partner(at(4)));     // .do ... .while
+        EXPECT_EQ(at(4), store.partner(at(5)));
+        EXPECT_EQ(at(9), store.partner(at(8)));     // .while ... .wend
+        EXPECT_EQ(at(8), store.partner(at(9)));
+        EXPECT_EQ(at(12), store.partner(at(11)));
+        EXPECT_EQ(at(11), store.partner(at(12)));
+        EXPECT_EQ(TokenStore::npos, store.partner(at(1) + 1));
+
+        // links after splices match a store built from the result, except
+        // the closers of an erased .if
+        auto expectRelinked = [](const TokenStore& s)
+            {
+                TokenStore fresh(s.slice(0, s.size()));
+                for (size_t i = 0; i < s.size(); ++i) {
+                    if (!s.openerErased(i)) {
+                        ASSERT_EQ(fresh.partner(i), s.partner(i)) << i;
+                    }
+                }
+            };
+        store.insert(at(8), store.range(at(2), at(7)));     // nested block into the .else
+        expectRelinked(store);
+        store.insert(0, store.range(at(7), at(8)));         // unmatched .else: relinks all
+        expectRelinked(store);
+        store.insert(store.size(), store.range(at(11), at(13)));
+        expectRelinked(store);
+        store.erase(at(4), at(6));                          // the .do loop
+        expectRelinked(store);
+        store.erase(0, at(2));                              // the .else and the .if
+        expectRelinked(store);
+        std::vector<size_t> closers;
+        for (size_t i = 0; i < store.size(); ++i) {
+            if (store.openerErased(i)) closers.push_back(i);
+        }
+        ASSERT_EQ(2u, closers.size());
+        EXPECT_EQ(ELSE_DIR, store.type(closers[0]));
+        EXPECT_EQ(closers[1], store.partner(closers[0]));
+        EXPECT_EQ(closers[0], store.partner(closers[1]));
+
+        // erasing a directive leaves its partners unmatched, except a .if or
+        // .else: the rest of the conditional stays linked
+        TokenStore part(tokens);
+        part.erase(at(11), at(12));
+        EXPECT_EQ(TokenStore::npos, part.partner(at(11)));
+        part.erase(at(7), at(8));
+        size_t endif = at(10) - (at(8) - at(7));
+        EXPECT_EQ(endif, part.partner(at(1)));
+        EXPECT_EQ(at(1), part.partner(endif));
+        part.erase(at(2), at(3));                           // the .ifdef
+        size_t inner = at(6) - (at(3) - at(2));
+        EXPECT_EQ(inner, part.partner(at(2)));
+        EXPECT_EQ(at(2), part.partner(inner));
+        EXPECT_TRUE(part.openerErased(at(2)));
+        EXPECT_TRUE(part.openerErased(inner));
+        part.erase(at(2), at(2) + (at(4) - at(3)));         // and its .else
+        inner -= at(4) - at(3);
+        EXPECT_EQ(inner, part.partner(inner));
+        EXPECT_TRUE(part.openerErased(inner));
+        EXPECT_FALSE(part.openerErased(at(1)));
+    }
+
+    TEST(tok_unit_test, numeric_literals)
+    {
+        std::vector<std::pair<SourcePos, std::string>> lines = {
+            // 017 is decimal: \d+ wins the tie with 0[0-7]+
+            { SourcePos("numbers.asm", 1), " .word 1234, $12 34, %1010 0101, 0o17, 017, &17, 'A'" },
+            { SourcePos("numbers.asm", 2), " .word $FFFFFFFF, 4294967295" },
+        };
+        std::vector<int32_t> expected = { 1234, 0x1234, 0xA5, 15, 17, 15, 'A', -1, -1 };
+
+        for (auto regex : { false, true }) {
+            tokenizer.useRegex = regex;
+            auto tokens = tokenizer.tokenize(lines);
+            std::vector<int32_t> actual;
+            for (auto& tok : tokens) {
+                if (tok.type == DECNUM || tok.type == HEXNUM || tok.type == BINNUM || tok.type == OCTNUM || tok.type == CHAR)
+                    actual.push_back(tok.number);
+                else
+                    EXPECT_EQ(0, tok.number);
+            }
+            EXPECT_EQ(expected, actual);
+
+            TokenStore store(tokens);
+            for (size_t i = 0; i < tokens.size(); ++i) {
+                EXPECT_EQ(tokens[i].number, store.number(i));
+            }
+
+            // literals wider than 32 bits are rejected by the lexer
+            for (auto text : { " .word $100000000", " .word 4294967296", " .word %1 00000000 00000000 00000000 00000000" }) {
+                std::vector<std::pair<SourcePos, std::string>> bad = { { SourcePos("numbers.asm", 3), text } };
+                EXPECT_THROW(tokenizer.tokenize(bad), std::runtime_error);
+            }
+        }
+        tokenizer.useRegex = false;
+    }
+
+    TEST(tok_unit_test, source_text)
+    {
+        auto dir = fs::temp_directory_path() / "pasm_source_text_test";
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+
+        // with and without a final line feed, blank and \r\n lines
+        for (std::string text : { "lda #1\n\n  sta $2000\r\nrts\n", "lda #1\n\n  sta $2000\r\nrts", "" }) {
+            auto file = (dir / "text.asm").string();
+            std::ofstream(file, std::ios::binary) << text;
+
+            std::vector<std::pair<SourcePos, std::string>> expected;
+            std::ifstream f(file);
+            std::string line;
+            int l = 0;
+            while (std::getline(f, line)) {
+                expected.push_back({ SourcePos(file, ++l), line });
+            }
+
+            SourceText source(file, retainSourceFile(file));
+            ASSERT_EQ(expected.size(), source.size());
+            for (size_t i = 0; i < source.size(); ++i) {
+                EXPECT_EQ(expected[i].first, source.pos(i));
+                EXPECT_EQ(expected[i].second, source.line(i));
+            }
+            EXPECT_EQ(SourceText(expected).text(), source.text());
+
+            auto fromLines = tokenizer.tokenize(expected);
+            auto fromText = tokenizer.tokenize(source);
+            CompareTokens(fromLines, fromText);
+        }
+        fs::remove_all(dir);
+    }
+
+    TEST(tok_unit_test, retained_text_shared)
+    {
+        // lines tokenized again (a macro expansion or loop body in every
+        // pass) share the buffer of the first time
+        const std::vector<std::pair<SourcePos, std::string>> lines = {
+            { SourcePos("retained", 1), "    lda #retained_text_shared" },
+            { SourcePos("retained", 2), "    .byte 1, 2, 3" },
+        };
+        auto first = tokenizer.tokenize(lines);
+        const size_t bytes = retainedBufferBytes();
+        for (int i = 0; i < 10; ++i) {
+            auto again = tokenizer.tokenize(lines);
+            CompareTokens(first, again);
+            EXPECT_EQ(first[0].value.data(), again[0].value.data());
+        }
+        EXPECT_EQ(bytes, retainedBufferBytes());
+
+        auto other = retainText("retained_text_shared other");
+        EXPECT_EQ(other.data(), retainText("retained_text_shared other").data());
+        EXPECT_NE(other.data(), retainText("retained_text_shared another").data());
+    }
+
+    TEST(tok_unit_test, parallel_matches_serial)
+    {
+        std::vector<std::pair<SourcePos, std::string>> lines;
+        for (auto const& dir_entry : std::filesystem::directory_iterator{ startdir }) {
+            auto& path = dir_entry.path();
+            if (path.extension() != ".asm")
+                continue;
+
+            auto file = path.string();
+            std::ifstream f(file);
+            std::string line;
+            int l = 0;
+            while (std::getline(f, line)) {
+                lines.push_back({ SourcePos(file, ++l), line });
+            }
+        }
+        // enough lines to be split across threads
+        auto source = lines;
+        while (!source.empty() && lines.size() < 8192) {
+            lines.insert(lines.end(), source.begin(), source.end());
+        }
+
+        tokenizer.jobs = 1;
+        auto expected = tokenizer.tokenize(lines);
+        for (auto jobs : { 2u, 3u, 8u }) {
+            tokenizer.jobs = jobs;
+            auto actual = tokenizer.tokenize(lines);
+            CompareTokens(expected, actual);
+        }
+
+        // the first bad line is reported, whichever thread lexes it
+        lines[lines.size() / 3].second = "lda ` first";
+        lines[lines.size() / 2].second = "lda ` second";
+        std::string serialError, parallelError;
+        tokenizer.jobs = 1;
+        try { tokenizer.tokenize(lines); }
+        catch (const std::exception& e) { serialError = e.what(); }
+        tokenizer.jobs = 8;
+        try { tokenizer.tokenize(lines); }
+        catch (const std::exception& e) { parallelError = e.what(); }
+        tokenizer.jobs = 1;
+
+        EXPECT_FALSE(serialError.empty());
+        EXPECT_EQ(serialError, parallelError);
+    }
 
 #if 0
     TEST(maketests, tokens)